@@ -1,5 +1,5 @@
-/* CP2130 class - Version 1.2.6
-   Copyright (c) 2021-2024 Samuel Lourenço
+/* CP2130 class - Version 1.3.0
+   Copyright (c) 2021-2026 Samuel Lourenço
 
    This library is free software: you can redistribute it and/or modify it
    under the terms of the GNU Lesser General Public License as published by
@@ -19,7 +19,9 @@
 
 
 // Includes
+#include <algorithm>
 #include <cstring>
+#include <future>
 #include <iomanip>
 #include <sstream>
 #include "cp2130.h"
@@ -28,13 +30,127 @@ extern "C" {
 }
 
 // Definitions
-const unsigned int TR_TIMEOUT = 500;  // Transfer timeout in milliseconds
+const unsigned int TR_TIMEOUT = 500;  // Default transfer timeout in milliseconds (also used as the event handling timeout)
+const uint16_t GPIO_BITMAPS[11] = {   // GPIO bitmaps indexed by pin number (used to track the values set via configureGPIO())
+    CP2130::BMGPIO0, CP2130::BMGPIO1, CP2130::BMGPIO2, CP2130::BMGPIO3, CP2130::BMGPIO4, CP2130::BMGPIO5,
+    CP2130::BMGPIO6, CP2130::BMGPIO7, CP2130::BMGPIO8, CP2130::BMGPIO9, CP2130::BMGPIO10
+};
+
+// Specific to spiWriteRead()
+const size_t WRCHUNK_SIZE = 56;  // Maximum payload of each WriteRead command
 
 // Specific to getDescGeneric() and writeDescGeneric() (added in version 1.1.0)
 const uint16_t DESC_TBLSIZE = 0x0040;          // Descriptor table size, including preamble [64]
 const size_t DESC_MAXIDX = DESC_TBLSIZE - 2;   // Maximum usable index [62]
 const size_t DESC_IDXINCR = DESC_TBLSIZE - 1;  // Index increment or step between table preambles [63]
 
+// Private structure that holds the state of each transfer submitted via bulkTransferAsync() (the structure is kept along with the transfer, and both are reused)
+struct CP2130::AsyncTransfer {
+    CP2130 *owner;                                    // Object that submitted the transfer
+    AsyncCallback callback;                           // Copy of the completion callback given to bulkTransferAsync()
+    const AsyncCallback *handler;                     // Completion callback to be called, which is either "callback" or one that the caller keeps valid until the transfer is reaped
+    std::list<libusb_transfer *>::iterator entry;     // Position of the transfer in the list of in-flight transfers, or in the list of idle transfers
+    std::chrono::steady_clock::time_point submitted;  // Time at which the transfer was submitted (only used for tracing)
+};
+
+// Private function that returns the timeout applicable to a bulk transfer on the given endpoint
+unsigned int CP2130::bulkTimeout(uint8_t endpointAddr) const
+{
+    return endpointAddr < 0x80 ? timeouts_.bulkOut : timeouts_.bulkIn;
+}
+
+// Private procedure used to record an event in the trace ring, overwriting the oldest event if the ring is full
+void CP2130::recordTrace(const char *category, const char *name, uint8_t key, int length, int result, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+    TraceEvent event;
+    event.category = category;
+    event.name = name;
+    event.key = key;
+    event.length = length;
+    event.result = result;
+    event.thread = std::this_thread::get_id();
+    event.begin = begin;
+    event.end = end;
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    traceRing_[traceRecorded_ % traceRing_.size()] = event;  // The ring is allocated by enableTracing(), so no memory is allocated here
+    ++traceRecorded_;
+}
+
+// Private procedure used to update the statistics of a transfer that was just issued, given the number of bytes transferred, its result and the time at which it was issued
+// Only relaxed atomic operations are used, so that the overhead is negligible when compared to the transfer itself
+void CP2130::recordTransfer(StatsEntry &entry, int bytes, int result, bool failed, std::chrono::steady_clock::time_point start)
+{
+    uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    size_t bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && elapsed >> bucket != 0) {  // Equivalent to the position of the most significant bit set, plus one
+        ++bucket;
+    }
+    entry.transfers.fetch_add(1, std::memory_order_relaxed);
+    if (bytes > 0) {
+        entry.bytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+    }
+    if (failed) {
+        entry.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (result == LIBUSB_ERROR_TIMEOUT) {
+        entry.timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+    entry.totalTime.fetch_add(elapsed, std::memory_order_relaxed);
+    entry.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Private procedure used to remember the location and serial number of the open device, so that reconnect() can find it again
+void CP2130::rememberLocation()
+{
+    libusb_device *device = libusb_get_device(handle_);
+    uint8_t ports[USBContext::MAX_PORT_DEPTH];
+    int nports = libusb_get_port_numbers(device, ports, static_cast<int>(sizeof(ports)));
+    bus_ = libusb_get_bus_number(device);
+    ports_.assign(ports, ports + (nports > 0 ? nports : 0));
+    serial_ = serialNumber(handle_);
+}
+
+// Private procedure used to report a failed transfer, either by appending the respective message to "errstr" or, if the error ring is enabled, by recording it
+// In the latter case, no memory is allocated, and the message can be obtained later on via errorMessage()
+void CP2130::reportError(uint8_t type, uint8_t endpointAddr, uint8_t bmRequestType, uint8_t bRequest, int status, int &errcnt, std::string &errstr)
+{
+    ++errcnt;
+    ErrorRecord record;
+    record.type = type;
+    record.endpointAddr = endpointAddr;
+    record.bmRequestType = bmRequestType;
+    record.bRequest = bRequest;
+    record.status = status;
+    if (errorRingEnabled_) {
+        errorRing_[errorsRecorded_ % ERROR_RING_SIZE] = record;  // The ring is allocated by enableErrorRing(), so this only overwrites the oldest record, if full
+        ++errorsRecorded_;
+    } else {
+        errstr += errorMessage(record);
+    }
+}
+
+// Private function used to claim the interface of the given device handle, detaching the kernel driver if needed, and returns true if successful
+bool CP2130::claimInterface(libusb_device_handle *handle)
+{
+    if (libusb_kernel_driver_active(handle, 0) == 1) {  // If a kernel driver is active on the interface
+        libusb_detach_kernel_driver(handle, 0);  // Detach the kernel driver
+        kernelWasAttached_ = true;  // Flag that the kernel driver was attached
+    } else {
+        kernelWasAttached_ = false;  // The kernel driver was not attached
+    }
+    bool claimed = libusb_claim_interface(handle, 0) == 0;  // Claim the interface
+    if (!claimed && kernelWasAttached_) {  // In case of failure, and if a kernel driver was attached to the interface before
+        libusb_attach_kernel_driver(handle, 0);  // Reattach the kernel driver
+    }
+    return claimed;
+}
+
+// Private function used to handle pending events for up to the given timeout, either via the transport or via libusb, and returns zero if successful
+int CP2130::handleEventsTimeout(timeval *timeout)
+{
+    return transport_ != nullptr ? transport_->handleEvents(timeout) : libusb_handle_events_timeout_completed(context_.get(), timeout, nullptr);
+}
+
 // Private generic procedure used to get any descriptor (added as a refactor in version 1.1.0)
 std::u16string CP2130::getDescGeneric(uint8_t command, int &errcnt, std::string &errstr)
 {
@@ -88,6 +204,285 @@ void CP2130::writeDescGeneric(const std::u16string &descriptor, uint8_t command,
     }
 }
 
+// Private generic procedure used to issue a READ or ReadWithRTR command, and then drain the IN endpoint while keeping several transfers in flight
+// The received data is passed to "sink" in order, and the stream ends when all the requested bytes are received, "sink" returns false, stopRTR() is called or an error occurs
+// Stopping only cancels the pending transfers, while the ReadWithRTR command is aborted once every transfer is reaped, since no synchronous control transfer may be issued from within a transfer callback
+size_t CP2130::readStream(uint8_t command, uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, unsigned int timeout, const std::function<bool(const uint8_t *, size_t)> &sink, int &errcnt, std::string &errstr)
+{
+    size_t bytesRead = 0;
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += command == READWITHRTR ? "In spiReadWithRTR(): device is not open.\n" : "In spiReadAsync(): device is not open.\n";  // Program logic error
+    } else {
+        std::vector<unsigned char> readInputBuffer(asyncQueueDepth_ * ASYNC_CHUNK_SIZE);  // One chunk per in-flight transfer, all allocated at once
+        uint32_t bytesRequested = 0;
+        size_t inFlight = 0;
+        bool failed = false;
+        streamStopped_ = false;
+        std::function<void(unsigned char *)> submitChunk;
+        AsyncCallback readCallback = [&](int status, unsigned char *chunk, int transferred) {  // Shared by every IN transfer, so that no callback is allocated per transfer
+            --inFlight;
+            if (transferred > 0 && !streamStopped_) {
+                bytesRead += static_cast<size_t>(transferred);
+                bool proceed = sink(chunk, static_cast<size_t>(transferred));  // Transfers on the same endpoint always complete in the order they were submitted, so the data is passed along in order
+                if (!proceed || rtrStopRequested_) {  // No control transfer is issued here, since this runs in event handling context
+                    rtrStopRequested_ = rtrStopRequested_ || command == READWITHRTR;  // The ReadWithRTR command is aborted after the event loop returns
+                    streamStopped_ = true;
+                    cancelAsyncTransfers();
+                }
+            }
+            if (status != LIBUSB_TRANSFER_COMPLETED) {
+                failed = failed || status != LIBUSB_TRANSFER_CANCELLED || !streamStopped_;  // Transfers cancelled because the stream was stopped are not failures
+            } else if (!failed && !streamStopped_ && bytesRequested < bytesToRead) {
+                submitChunk(chunk);  // Reuse the chunk, now that its data was consumed
+            }
+        };
+        submitChunk = [&](unsigned char *chunk) {
+            uint32_t bytesRemaining = bytesToRead - bytesRequested;
+            int length = static_cast<int>(bytesRemaining > ASYNC_CHUNK_SIZE ? ASYNC_CHUNK_SIZE : bytesRemaining);
+            int preverrcnt = errcnt;
+            submitAsyncTransfer(endpointInAddr, chunk, length, timeout, readCallback, false, errcnt, errstr);
+            if (errcnt == preverrcnt) {
+                bytesRequested += static_cast<uint32_t>(length);
+                ++inFlight;
+            } else {
+                failed = true;
+            }
+        };
+        {
+            std::lock_guard<std::mutex> lock(streamMutex_);
+            streaming_ = true;
+            rtrStopRequested_ = false;
+        }
+        for (size_t i = 0; i < asyncQueueDepth_ && bytesRequested < bytesToRead && !failed; ++i) {
+            submitChunk(&readInputBuffer[i * ASYNC_CHUNK_SIZE]);  // The IN transfers are submitted before the command, so that they are already waiting when the data arrives
+        }
+        unsigned char commandBuffer[8] = {
+            0x00, 0x00,  // Reserved
+            command,     // Read or ReadWithRTR command
+            0x00,        // Reserved
+            static_cast<uint8_t>(bytesToRead),
+            static_cast<uint8_t>(bytesToRead >> 8),
+            static_cast<uint8_t>(bytesToRead >> 16),
+            static_cast<uint8_t>(bytesToRead >> 24)
+        };
+        if (!failed) {
+            int preverrcnt = errcnt;
+#if LIBUSB_API_VERSION >= 0x01000105
+            bulkTransfer(endpointOutAddr, commandBuffer, static_cast<int>(sizeof(commandBuffer)), nullptr, errcnt, errstr);
+#else
+            int bytesWritten;
+            bulkTransfer(endpointOutAddr, commandBuffer, static_cast<int>(sizeof(commandBuffer)), &bytesWritten, errcnt, errstr);
+#endif
+            failed = errcnt != preverrcnt;
+        }
+        if (failed) {
+            cancelAsyncTransfers();
+        }
+        while (inFlight > 0) {  // Note that the local variables referenced by the callbacks must remain valid until every transfer is reaped
+            int preverrcnt = errcnt;
+            handleEvents(errcnt, errstr);
+            if (errcnt != preverrcnt && !failed) {
+                failed = true;
+                cancelAsyncTransfers();
+            } else if (rtrStopRequested_ && !streamStopped_ && !failed) {  // stopRTR() was called from another thread
+                streamStopped_ = true;
+                cancelAsyncTransfers();
+            }
+        }
+        bool stopRequested;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex_);
+            streaming_ = false;
+            stopRequested = rtrStopRequested_.exchange(false);
+        }
+        if (stopRequested) {
+            stopRTR(errcnt, errstr);  // Now that streaming_ is false, this issues the SET_RTR_STOP request
+        }
+        if (bytesRead != bytesToRead && !failed && !streamStopped_) {
+            ++errcnt;
+            errstr += command == READWITHRTR ? "In spiReadWithRTR(): received fewer bytes than requested.\n" : "In spiReadAsync(): received fewer bytes than requested.\n";
+        }
+    }
+    return bytesRead;
+}
+
+// Private procedure used to apply the remembered SPI modes and delays, GPIO modes and values, and chip selects to a freshly reconnected device
+// The GPIO values are restored after the pin modes, and the chip selects are restored last
+void CP2130::restoreState(int &errcnt, std::string &errstr)
+{
+    for (uint8_t channel = 0; channel < 11; ++channel) {
+        if ((spiModesSet_ & 1 << channel) != 0) {
+            configureSPIMode(channel, spiModes_[channel], errcnt, errstr);
+        }
+        if ((spiDelaysSet_ & 1 << channel) != 0) {
+            configureSPIDelays(channel, spiDelays_[channel], errcnt, errstr);
+        }
+    }
+    for (uint8_t pin = 0; pin < 11; ++pin) {
+        if ((gpioModesSet_ & 1 << pin) != 0) {
+            configureGPIO(pin, gpioModes_[pin], (gpioValues_ & GPIO_BITMAPS[pin]) != 0x0000, errcnt, errstr);
+        }
+    }
+    if (gpioValuesSet_ != 0x0000) {
+        setGPIOs(gpioValues_, gpioValuesSet_, errcnt, errstr);
+    }
+    for (uint8_t channel = 0; channel < 11; ++channel) {
+        if ((csSet_ & 1 << channel) != 0) {
+            if ((csEnabled_ & 1 << channel) != 0) {
+                enableCS(channel, errcnt, errstr);
+            } else {
+                disableCS(channel, errcnt, errstr);
+            }
+        }
+    }
+}
+
+// Private procedure used to submit a bulk transfer with the given timeout (a timeout of zero means that the transfer never times out)
+// If "copyCallback" is false, the callback is not copied, and so it must remain valid until the transfer is reaped
+// Transfers are taken from the list of idle transfers, and only allocated if none is left
+void CP2130::submitAsyncTransfer(uint8_t endpointAddr, unsigned char *data, int length, unsigned int timeout, const std::function<void(int, unsigned char *, int)> &callback, bool copyCallback, int &errcnt, std::string &errstr)
+{
+    if (failFast_ && deviceLost_) {  // In fail-fast mode, no transfers are issued once the device is known to be disconnected
+        reportError(ETSKIPBULK, endpointAddr, 0x00, 0x00, LIBUSB_ERROR_NO_DEVICE, errcnt, errstr);
+    } else {
+        if (asyncIdleTransfers_.empty()) {
+            libusb_transfer *transfer = libusb_alloc_transfer(0);
+            if (transfer != nullptr) {
+                AsyncTransfer *asyncTransfer = new AsyncTransfer;
+                asyncTransfer->owner = this;
+                asyncTransfer->entry = asyncIdleTransfers_.insert(asyncIdleTransfers_.end(), transfer);
+                transfer->user_data = asyncTransfer;
+            }
+        }
+        if (asyncIdleTransfers_.empty()) {
+            ++errcnt;
+            errstr += "Failed to allocate asynchronous bulk transfer.\n";
+        } else {
+            libusb_transfer *transfer = asyncIdleTransfers_.front();
+            AsyncTransfer *asyncTransfer = static_cast<AsyncTransfer *>(transfer->user_data);
+            if (copyCallback) {
+                asyncTransfer->callback = callback;
+                asyncTransfer->handler = &asyncTransfer->callback;
+            } else {
+                asyncTransfer->handler = &callback;
+            }
+            asyncTransfers_.splice(asyncTransfers_.end(), asyncIdleTransfers_, asyncTransfer->entry);  // Note that the iterator remains valid
+            asyncTransfer->submitted = std::chrono::steady_clock::now();
+            libusb_fill_bulk_transfer(transfer, handle_, endpointAddr, data, length, asyncTransferCallback, asyncTransfer, timeout);
+            int result = transport_ != nullptr ? transport_->submitTransfer(transfer) : libusb_submit_transfer(transfer);
+            if (result != 0) {
+                reportError(ETASYNCSUBMIT, endpointAddr, 0x00, 0x00, result, errcnt, errstr);
+                if (result == LIBUSB_ERROR_NO_DEVICE) {
+                    disconnected_ = deviceLost_ = true;  // This reports that the device has been disconnected
+                }
+                asyncTransfer->callback = nullptr;
+                asyncIdleTransfers_.splice(asyncIdleTransfers_.begin(), asyncTransfers_, asyncTransfer->entry);
+            }
+        }
+    }
+}
+
+// Private static function that is called by libusb on completion of any transfer submitted via bulkTransferAsync()
+void LIBUSB_CALL CP2130::asyncTransferCallback(libusb_transfer *transfer)
+{
+    AsyncTransfer *asyncTransfer = static_cast<AsyncTransfer *>(transfer->user_data);
+    CP2130 *owner = asyncTransfer->owner;
+    bool failed = transfer->status != LIBUSB_TRANSFER_COMPLETED && transfer->status != LIBUSB_TRANSFER_CANCELLED;  // Transfers that were cancelled are still accounted for, but not as failures
+    owner->recordTransfer(owner->bulkStats_[(0x0f & transfer->endpoint) | (0x80 & transfer->endpoint) >> 3], transfer->actual_length, transfer->status == LIBUSB_TRANSFER_TIMED_OUT ? LIBUSB_ERROR_TIMEOUT : 0, failed, asyncTransfer->submitted);
+    if (owner->tracingEnabled_) {
+        owner->recordTrace("async", nullptr, transfer->endpoint, transfer->length, transfer->status, asyncTransfer->submitted, std::chrono::steady_clock::now());
+    }
+    if (failed) {  // Errors are reported by the next call to handleEvents(), since there is no "errcnt" or "errstr" to append to at this point
+        owner->reportError(ETASYNC, transfer->endpoint, 0x00, 0x00, transfer->status, owner->asyncErrcnt_, owner->asyncErrstr_);
+        if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE || transfer->status == LIBUSB_TRANSFER_ERROR) {  // Equivalent to "LIBUSB_ERROR_NO_DEVICE" and "LIBUSB_ERROR_IO", as verified in bulkTransfer()
+            owner->disconnected_ = owner->deviceLost_ = true;  // This reports that the device has been disconnected
+        }
+    }
+    AsyncCallback callback;
+    callback.swap(asyncTransfer->callback);  // The copied callback is taken, since the transfer becomes idle and may be reused by the callback itself
+    const AsyncCallback *handler = asyncTransfer->handler == &asyncTransfer->callback ? &callback : asyncTransfer->handler;
+    int status = transfer->status;
+    unsigned char *buffer = transfer->buffer;
+    int actualLength = transfer->actual_length;
+    owner->asyncIdleTransfers_.splice(owner->asyncIdleTransfers_.begin(), owner->asyncTransfers_, asyncTransfer->entry);  // The transfer is reaped, and kept for reuse
+    if (*handler) {
+        bool inEventContext = owner->inEventContext_;
+        owner->inEventContext_ = true;  // Prevents any synchronous transfers issued by the callback from attempting to reconnect
+        (*handler)(status, buffer, actualLength);  // Note that the callback may submit further transfers
+        owner->inEventContext_ = inEventContext;
+    }
+}
+
+// Private static procedure used by enumerateDevices() to read the USB configuration and silicon version of the device referred by the given handle
+// The vendor requests are issued directly on the handle, which is not required to have its interface claimed, and so no CP2130 object is needed
+void CP2130::queryDevice(libusb_device_handle *handle, DeviceInfo &info, int &errcnt, std::string &errstr)
+{
+    ErrorRecord record = {ETCONTROL, 0x00, GET, 0x00, 0};
+    unsigned char controlBufferIn[GET_USB_CONFIG_WLEN];
+    int result = libusb_control_transfer(handle, GET, GET_USB_CONFIG, 0x0000, 0x0000, controlBufferIn, GET_USB_CONFIG_WLEN, TR_TIMEOUT);
+    if (result != GET_USB_CONFIG_WLEN) {
+        ++errcnt;
+        record.bRequest = GET_USB_CONFIG;
+        record.status = result < 0 ? result : 0;
+        errstr += errorMessage(record);
+    } else {
+        info.config.vid = static_cast<uint16_t>(controlBufferIn[1] << 8 | controlBufferIn[0]);  // VID corresponds to bytes 0 and 1 (little-endian conversion)
+        info.config.pid = static_cast<uint16_t>(controlBufferIn[3] << 8 | controlBufferIn[2]);  // PID corresponds to bytes 2 and 3 (little-endian conversion)
+        info.config.majrel = controlBufferIn[6];                                                // Major release version corresponds to byte 6
+        info.config.minrel = controlBufferIn[7];                                                // Minor release version corresponds to byte 7
+        info.config.maxpow = controlBufferIn[4];                                                // Maximum power consumption corresponds to byte 4
+        info.config.powmode = controlBufferIn[5];                                               // Power mode corresponds to byte 5
+        info.config.trfprio = controlBufferIn[8];                                               // Transfer priority corresponds to byte 8
+    }
+    result = libusb_control_transfer(handle, GET, GET_READONLY_VERSION, 0x0000, 0x0000, controlBufferIn, GET_READONLY_VERSION_WLEN, TR_TIMEOUT);  // The same buffer is reused, since it is large enough
+    if (result != GET_READONLY_VERSION_WLEN) {
+        ++errcnt;
+        record.bRequest = GET_READONLY_VERSION;
+        record.status = result < 0 ? result : 0;
+        errstr += errorMessage(record);
+    } else {
+        info.silicon.maj = controlBufferIn[0];  // Major read-only version corresponds to byte 0
+        info.silicon.min = controlBufferIn[1];  // Minor read-only version corresponds to byte 1
+    }
+}
+
+// Private static function that returns the serial number of the device referred by the given handle, or an empty string if it cannot be read
+std::string CP2130::serialNumber(libusb_device_handle *handle)
+{
+    std::string serial;
+    libusb_device_descriptor desc;
+    unsigned char str_desc[256];
+    if (libusb_get_device_descriptor(libusb_get_device(handle), &desc) == 0 && libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, str_desc, static_cast<int>(sizeof(str_desc))) >= 0) {  // Get the serial number string in ASCII format
+        serial = reinterpret_cast<char *>(str_desc);
+    }
+    return serial;
+}
+
+// "Equal to" operator for DeviceInfo
+bool CP2130::DeviceInfo::operator ==(const CP2130::DeviceInfo &other) const
+{
+    return serial == other.serial && bus == other.bus && ports == other.ports && address == other.address && config == other.config && silicon == other.silicon;
+}
+
+// "Not equal to" operator for DeviceInfo
+bool CP2130::DeviceInfo::operator !=(const CP2130::DeviceInfo &other) const
+{
+    return !(operator ==(other));
+}
+
+// "Equal to" operator for ErrorRecord
+bool CP2130::ErrorRecord::operator ==(const CP2130::ErrorRecord &other) const
+{
+    return type == other.type && endpointAddr == other.endpointAddr && bmRequestType == other.bmRequestType && bRequest == other.bRequest && status == other.status;
+}
+
+// "Not equal to" operator for ErrorRecord
+bool CP2130::ErrorRecord::operator !=(const CP2130::ErrorRecord &other) const
+{
+    return !(operator ==(other));
+}
+
 // "Equal to" operator for EventCounter
 bool CP2130::EventCounter::operator ==(const CP2130::EventCounter &other) const
 {
@@ -100,6 +495,84 @@ bool CP2130::EventCounter::operator !=(const CP2130::EventCounter &other) const
     return !(operator ==(other));
 }
 
+// Returns the value of the GPIO.0 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio0() const
+{
+    return (BMGPIO0 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.1 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio1() const
+{
+    return (BMGPIO1 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.2 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio2() const
+{
+    return (BMGPIO2 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.3 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio3() const
+{
+    return (BMGPIO3 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.4 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio4() const
+{
+    return (BMGPIO4 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.5 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio5() const
+{
+    return (BMGPIO5 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.6 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio6() const
+{
+    return (BMGPIO6 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.7 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio7() const
+{
+    return (BMGPIO7 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.8 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio8() const
+{
+    return (BMGPIO8 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.9 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio9() const
+{
+    return (BMGPIO9 & values) != 0x0000;
+}
+
+// Returns the value of the GPIO.10 pin, as captured by the snapshot
+bool CP2130::GPIOSnapshot::gpio10() const
+{
+    return (BMGPIO10 & values) != 0x0000;
+}
+
+// "Equal to" operator for GPIOSnapshot
+bool CP2130::GPIOSnapshot::operator ==(const CP2130::GPIOSnapshot &other) const
+{
+    return values == other.values;
+}
+
+// "Not equal to" operator for GPIOSnapshot
+bool CP2130::GPIOSnapshot::operator !=(const CP2130::GPIOSnapshot &other) const
+{
+    return !(operator ==(other));
+}
+
 // "Equal to" operator for PinConfig
 bool CP2130::PinConfig::operator ==(const CP2130::PinConfig &other) const
 {
@@ -184,6 +657,34 @@ bool CP2130::SPIMode::operator !=(const CP2130::SPIMode &other) const
     return !(operator ==(other));
 }
 
+// "Equal to" operator for Timeouts
+bool CP2130::Timeouts::operator ==(const CP2130::Timeouts &other) const
+{
+    return control == other.control && bulkOut == other.bulkOut && bulkIn == other.bulkIn;
+}
+
+// "Not equal to" operator for Timeouts
+bool CP2130::Timeouts::operator !=(const CP2130::Timeouts &other) const
+{
+    return !(operator ==(other));
+}
+
+// "Equal to" operator for TransferStats
+bool CP2130::TransferStats::operator ==(const CP2130::TransferStats &other) const
+{
+    bool equal = type == other.type && key == other.key && transfers == other.transfers && bytes == other.bytes && errors == other.errors && timeouts == other.timeouts && totalTime == other.totalTime;
+    for (size_t i = 0; equal && i < STATS_BUCKETS; ++i) {
+        equal = histogram[i] == other.histogram[i];
+    }
+    return equal;
+}
+
+// "Not equal to" operator for TransferStats
+bool CP2130::TransferStats::operator !=(const CP2130::TransferStats &other) const
+{
+    return !(operator ==(other));
+}
+
 // "Equal to" operator for USBConfig
 bool CP2130::USBConfig::operator ==(const CP2130::USBConfig &other) const
 {
@@ -197,11 +698,65 @@ bool CP2130::USBConfig::operator !=(const CP2130::USBConfig &other) const
 }
 
 CP2130::CP2130() :
-    context_(nullptr),
+    CP2130(USBContext(nullptr))
+{
+}
+
+// Constructs an object that uses the given context, which may be shared with other objects
+// In this case, libusb is neither initialized by open() nor deinitialized by close(), and devices are looked up using the device list cached by the context
+// A null context is equivalent to none, and so libusb is then initialized by open() and deinitialized by close(), as with the default constructor
+// Note that the events of all objects sharing the context must be handled by the same thread (see USBContext::handleEvents())
+CP2130::CP2130(const USBContext &context) :
+    context_(context),
     handle_(nullptr),
+    transport_(nullptr),
+    sharedContext_(!context.isNull()),
     disconnected_(false),
-    kernelWasAttached_(false)
-{
+    deviceLost_(false),
+    kernelWasAttached_(false),
+    streaming_(false),
+    streamStopped_(false),
+    trfprioCached_(false),
+    gpioShadowEnabled_(false),
+    failFast_(false),
+    autoReconnect_(false),
+    reconnecting_(false),
+    inEventContext_(false),
+    trfprio_(PRIOREAD),
+    gpioShadow_(0x0000),
+    asyncQueueDepth_(ASYNC_QUEUE_DEPTH),
+    asyncErrcnt_(0),
+    asyncErrstr_(),
+    asyncTransfers_(),
+    asyncIdleTransfers_(),
+    rtrStopRequested_(false),
+    errorRingEnabled_(false),
+    errorsRecorded_(0),
+    bus_(0),
+    ports_(),
+    serial_(),
+    gpioModes_(),
+    spiModesSet_(0x0000),
+    spiDelaysSet_(0x0000),
+    gpioModesSet_(0x0000),
+    csSet_(0x0000),
+    csEnabled_(0x0000),
+    gpioValuesSet_(0x0000),
+    gpioValues_(0x0000),
+    tracingEnabled_(false),
+    traceEpoch_(),
+    traceRing_(),
+    traceRecorded_(0),
+    errorRing_(),
+    timeouts_(),
+    spiModes_(),
+    spiDelays_(),
+    controlStats_(256),
+    bulkStats_(32)
+{
+    timeouts_.control = TR_TIMEOUT;
+    timeouts_.bulkOut = TR_TIMEOUT;
+    timeouts_.bulkIn = TR_TIMEOUT;
 }
 
 CP2130::~CP2130()
@@ -209,16 +764,196 @@ CP2130::~CP2130()
     close();  // The destructor is used to close the device, and this is essential so the device can be freed when the parent object is destroyed
 }
 
+// Returns the number of IN transfers (or WriteRead commands) that are kept in flight by spiReadAsync(), spiReadWithRTR() and spiWriteRead()
+size_t CP2130::asyncQueueDepth() const
+{
+    return asyncQueueDepth_;
+}
+
+// Returns the context in use, which is null if the device is not open, unless a shared context was given at construction
+// This allows other objects to handle events or register hotplug callbacks within the same context
+USBContext CP2130::context() const
+{
+    return context_;
+}
+
 // Diagnostic function used to verify if the device has been disconnected
 bool CP2130::disconnected() const
 {
     return disconnected_;  // Returns true if the device has been disconnected, or false otherwise
 }
 
+// Returns the records kept by the error ring, from the oldest to the most recent
+std::vector<CP2130::ErrorRecord> CP2130::errorRecords() const
+{
+    std::vector<ErrorRecord> records;
+    size_t nrecords = errorsRecorded_ < ERROR_RING_SIZE ? errorsRecorded_ : ERROR_RING_SIZE;
+    records.reserve(nrecords);
+    for (size_t i = errorsRecorded_ - nrecords; i < errorsRecorded_; ++i) {
+        records.push_back(errorRing_[i % ERROR_RING_SIZE]);
+    }
+    return records;
+}
+
+// Returns the GPIO shadow, which holds the GPIO values as last read by getGPIOs() or written by setGPIOs(), without issuing any control transfers
+// Note that the shadow is only kept up to date while enabled (see enableGPIOShadow()), and that it does not reflect changes on input pins since the last read
+CP2130::GPIOSnapshot CP2130::gpioShadow() const
+{
+    GPIOSnapshot snapshot;
+    snapshot.values = gpioShadow_;
+    return snapshot;
+}
+
+// Checks if automatic reconnection is enabled
+bool CP2130::isAutoReconnectEnabled() const
+{
+    return autoReconnect_;
+}
+
+// Checks if the error ring is enabled
+bool CP2130::isErrorRingEnabled() const
+{
+    return errorRingEnabled_;
+}
+
+// Checks if fail-fast mode is enabled
+bool CP2130::isFailFastEnabled() const
+{
+    return failFast_;
+}
+
+// Checks if the GPIO shadow is enabled
+bool CP2130::isGPIOShadowEnabled() const
+{
+    return gpioShadowEnabled_;
+}
+
 // Checks if the device is open
 bool CP2130::isOpen() const
 {
-    return handle_ != nullptr;  // Returns true if the device is open, or false otherwise
+    return handle_ != nullptr || transport_ != nullptr;  // Returns true if the device is open, or false otherwise
+}
+
+// Checks if tracing is enabled
+bool CP2130::isTracingEnabled() const
+{
+    return tracingEnabled_;
+}
+
+// Returns the number of error records that were overwritten since the error ring was last cleared, because they were not retrieved in time
+size_t CP2130::lostErrorRecords() const
+{
+    return errorsRecorded_ > ERROR_RING_SIZE ? errorsRecorded_ - ERROR_RING_SIZE : 0;
+}
+
+// Returns the number of trace events that were overwritten since the trace was last cleared, because the trace ring was full
+size_t CP2130::lostTraceEvents() const
+{
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    return traceRecorded_ > traceRing_.size() ? traceRecorded_ - traceRing_.size() : 0;
+}
+
+// Returns the number of transfers submitted via bulkTransferAsync() that are still in flight
+size_t CP2130::pendingTransfers() const
+{
+    return asyncTransfers_.size();
+}
+
+// Returns the timeouts applicable to each type of transfer
+CP2130::Timeouts CP2130::timeouts() const
+{
+    return timeouts_;
+}
+
+// Returns the events kept by the trace ring as a JSON document in the Chrome trace event format, which can be loaded by chrome://tracing or by Perfetto
+// Asynchronous transfers are exported as pairs of async begin and end events, since they overlap each other, while all other events are exported as complete events
+// Events are timestamped in microseconds since tracing was enabled or the trace was last cleared - Threads are numbered in order of appearance
+std::string CP2130::traceJSON() const
+{
+    std::vector<TraceEvent> events;
+    std::chrono::steady_clock::time_point epoch;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex_);
+        epoch = traceEpoch_;
+        size_t nevents = traceRecorded_ < traceRing_.size() ? traceRecorded_ : traceRing_.size();
+        events.reserve(nevents);
+        for (size_t i = traceRecorded_ - nevents; i < traceRecorded_; ++i) {
+            events.push_back(traceRing_[i % traceRing_.size()]);
+        }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const TraceEvent &a, const TraceEvent &b) {
+        return a.begin < b.begin;  // Events are recorded as they end, so they are sorted by their beginning, for the sake of readability
+    });
+    std::vector<std::thread::id> threads;
+    std::ostringstream stream;
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent &event = events[i];
+        bool async = event.name == nullptr && std::strcmp(event.category, "async") == 0;
+        size_t tid = std::find(threads.begin(), threads.end(), event.thread) - threads.begin();
+        if (tid == threads.size()) {
+            threads.push_back(event.thread);
+        }
+        stream << (i == 0 ? "\n" : ",\n")
+               << "{\"name\":\"";
+        if (event.name != nullptr) {
+            stream << event.name;
+        } else {
+            stream << event.category << " 0x" << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(event.key) << std::dec;
+        }
+        stream << "\",\"cat\":\"" << event.category << "\",\"ts\":" << std::chrono::duration_cast<std::chrono::microseconds>(event.begin - epoch).count();
+        if (async) {  // Asynchronous transfers overlap each other, so they are exported as async slices instead
+            stream << ",\"ph\":\"b\",\"id\":" << i << ",\"pid\":1,\"tid\":" << tid + 1 << "},\n"
+                   << "{\"name\":\"async 0x" << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(event.key) << std::dec
+                   << "\",\"cat\":\"" << event.category << "\",\"ts\":" << std::chrono::duration_cast<std::chrono::microseconds>(event.end - epoch).count()
+                   << ",\"ph\":\"e\",\"id\":" << i;
+        } else {
+            stream << ",\"ph\":\"X\",\"dur\":" << std::chrono::duration_cast<std::chrono::microseconds>(event.end - event.begin).count();
+        }
+        stream << ",\"pid\":1,\"tid\":" << tid + 1;
+        if (event.name == nullptr) {  // In the case of transfers, the requested length and the result are included as arguments
+            stream << ",\"args\":{\"length\":" << event.length << (async ? ",\"status\":" : ",\"result\":") << event.result << "}";
+        }
+        stream << "}";
+    }
+    stream << "\n]}\n";
+    return stream.str();
+}
+
+// Returns a snapshot of the transfer statistics, with one entry per request (control transfers) or endpoint (bulk transfers) that was used since the statistics were last cleared
+// Every control and bulk transfer is accounted for, including those issued by the other functions - Asynchronous transfers are accounted for along with the synchronous bulk transfers on the same endpoint, with their latency measured from submission to completion
+std::vector<CP2130::TransferStats> CP2130::transferStats() const
+{
+    std::vector<TransferStats> stats;
+    for (size_t i = 0; i < controlStats_.size() + bulkStats_.size(); ++i) {
+        bool control = i < controlStats_.size();
+        const StatsEntry &entry = control ? controlStats_[i] : bulkStats_[i - controlStats_.size()];
+        if (entry.transfers.load(std::memory_order_relaxed) != 0) {
+            size_t index = control ? i : i - controlStats_.size();
+            TransferStats entryStats;
+            entryStats.type = control ? ETCONTROL : ETBULK;
+            entryStats.key = static_cast<uint8_t>(control ? index : (0x0f & index) | (0x10 & index) << 3);  // In the case of bulk transfers, the index is converted back to an endpoint address
+            entryStats.transfers = entry.transfers.load(std::memory_order_relaxed);
+            entryStats.bytes = entry.bytes.load(std::memory_order_relaxed);
+            entryStats.errors = entry.errors.load(std::memory_order_relaxed);
+            entryStats.timeouts = entry.timeouts.load(std::memory_order_relaxed);
+            entryStats.totalTime = entry.totalTime.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < STATS_BUCKETS; ++j) {
+                entryStats.histogram[j] = entry.histogram[j].load(std::memory_order_relaxed);
+            }
+            stats.push_back(entryStats);
+        }
+    }
+    return stats;
+}
+
+// Records an event in the trace, if tracing is enabled, so that higher level operations (e.g., those of ITUSB1Device) appear alongside the transfers they issue
+// The category and name should be string literals, since only the pointers are kept, and must not contain characters that need escaping in JSON
+void CP2130::addTraceEvent(const char *category, const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+    if (tracingEnabled_) {
+        recordTrace(category, name, 0x00, 0, 0, begin, end);
+    }
 }
 
 // Safe bulk transfer
@@ -227,27 +962,82 @@ void CP2130::bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length,
     if (!isOpen()) {
         ++errcnt;
         errstr += "In bulkTransfer(): device is not open.\n";  // Program logic error
+    } else if (autoReconnect_ && deviceLost_ && !reconnecting_ && !inEventContext_ && !reconnect(errcnt, errstr)) {  // With auto-reconnect enabled, an attempt to reconnect is made before the transfer is issued (except from within a transfer callback)
+        reportError(ETSKIPBULK, endpointAddr, 0x00, 0x00, LIBUSB_ERROR_NO_DEVICE, errcnt, errstr);
+    } else if (failFast_ && deviceLost_) {  // In fail-fast mode, no transfers are issued once the device is known to be disconnected, so that no timeouts are incurred
+        reportError(ETSKIPBULK, endpointAddr, 0x00, 0x00, LIBUSB_ERROR_NO_DEVICE, errcnt, errstr);
     } else {
-        int result = libusb_bulk_transfer(handle_, endpointAddr, data, length, transferred, TR_TIMEOUT);
-        if (result != 0 || (transferred != nullptr && *transferred != length)) {  // The number of transferred bytes is also verified, as long as a valid (non-null) pointer is passed via "transferred"
-            ++errcnt;
-            std::ostringstream stream;
-            if (endpointAddr < 0x80) {
-                stream << "Failed bulk OUT transfer to endpoint "
-                       << (0x0f & endpointAddr)
-                       << " (address 0x"
-                       << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(endpointAddr)
-                       << ")." << std::endl;
-            } else {
-                stream << "Failed bulk IN transfer from endpoint "
-                       << (0x0f & endpointAddr)
-                       << " (address 0x"
-                       << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(endpointAddr)
-                       << ")." << std::endl;
-            }
-            errstr += stream.str();
+        int ntransferred = 0;
+        int *ptransferred = transferred != nullptr ? transferred : &ntransferred;  // The number of transferred bytes is always retrieved, since it is accounted for by the transfer statistics
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int result = transport_ != nullptr ? transport_->bulkTransfer(endpointAddr, data, length, ptransferred, bulkTimeout(endpointAddr)) : libusb_bulk_transfer(handle_, endpointAddr, data, length, ptransferred, bulkTimeout(endpointAddr));
+        bool failed = result != 0 || (transferred != nullptr && *transferred != length);  // The number of transferred bytes is also verified, as long as a valid (non-null) pointer is passed via "transferred"
+        recordTransfer(bulkStats_[(0x0f & endpointAddr) | (0x80 & endpointAddr) >> 3], *ptransferred, result, failed, start);
+        if (tracingEnabled_) {
+            recordTrace("bulk", nullptr, endpointAddr, length, result == 0 ? *ptransferred : result, start, std::chrono::steady_clock::now());
+        }
+        if (failed) {
+            reportError(ETBULK, endpointAddr, 0x00, 0x00, result, errcnt, errstr);
             if (result == LIBUSB_ERROR_NO_DEVICE || result == LIBUSB_ERROR_IO) {  // Note that libusb_bulk_transfer() may return "LIBUSB_ERROR_IO" [-1] on device disconnect
-                disconnected_ = true;  // This reports that the device has been disconnected
+                disconnected_ = deviceLost_ = true;  // This reports that the device has been disconnected
+            }
+        }
+    }
+}
+
+// Asynchronous bulk transfer
+// The transfer is submitted and this function returns immediately - The given callback is called from within handleEvents(), once the transfer completes
+// Important: the memory pointed by "data" must remain valid until then!
+void CP2130::bulkTransferAsync(uint8_t endpointAddr, unsigned char *data, int length, const AsyncCallback &callback, int &errcnt, std::string &errstr)
+{
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In bulkTransferAsync(): device is not open.\n";  // Program logic error
+    } else {
+        submitAsyncTransfer(endpointAddr, data, length, bulkTimeout(endpointAddr), callback, true, errcnt, errstr);
+    }
+}
+
+// Cancels every in-flight transfer submitted via bulkTransferAsync()
+// Note that the respective callbacks are still called, with "status" set to LIBUSB_TRANSFER_CANCELLED, as soon as events are handled
+void CP2130::cancelAsyncTransfers()
+{
+    for (std::list<libusb_transfer *>::iterator it = asyncTransfers_.begin(); it != asyncTransfers_.end(); ++it) {
+        if (transport_ != nullptr) {
+            transport_->cancelTransfer(*it);
+        } else {
+            libusb_cancel_transfer(*it);
+        }
+    }
+}
+
+// Discards all records kept by the error ring
+void CP2130::clearErrorRecords()
+{
+    errorsRecorded_ = 0;
+}
+
+// Discards all events kept by the trace ring, and restarts the trace timestamps from zero
+void CP2130::clearTrace()
+{
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    traceRecorded_ = 0;
+    traceEpoch_ = std::chrono::steady_clock::now();
+}
+
+// Resets the transfer statistics
+void CP2130::clearTransferStats()
+{
+    std::vector<StatsEntry> *tables[2] = {&controlStats_, &bulkStats_};
+    for (size_t i = 0; i < 2; ++i) {
+        for (std::vector<StatsEntry>::iterator it = tables[i]->begin(); it != tables[i]->end(); ++it) {
+            it->transfers.store(0, std::memory_order_relaxed);
+            it->bytes.store(0, std::memory_order_relaxed);
+            it->errors.store(0, std::memory_order_relaxed);
+            it->timeouts.store(0, std::memory_order_relaxed);
+            it->totalTime.store(0, std::memory_order_relaxed);
+            for (size_t j = 0; j < STATS_BUCKETS; ++j) {
+                it->histogram[j].store(0, std::memory_order_relaxed);
             }
         }
     }
@@ -257,16 +1047,45 @@ void CP2130::bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length,
 void CP2130::close()
 {
     if (isOpen()) {  // This condition avoids a segmentation fault if the calling algorithm tries, for some reason, to close the same device twice (e.g., if the device is already closed when the destructor is called)
-        libusb_release_interface(handle_, 0);  // Release the interface
-        if (kernelWasAttached_) {  // If a kernel driver was attached to the interface before
-            libusb_attach_kernel_driver(handle_, 0);  // Reattach the kernel driver
+        cancelAsyncTransfers();  // Any transfers still in flight must be cancelled and reaped before the device is closed
+        timeval timeout = {TR_TIMEOUT / 1000, 1000 * (TR_TIMEOUT % 1000)};
+        while (!asyncTransfers_.empty() && handleEventsTimeout(&timeout) == 0) {
+        }
+        for (std::list<libusb_transfer *>::iterator it = asyncIdleTransfers_.begin(); it != asyncIdleTransfers_.end(); ++it) {  // The idle transfers are freed, along with their state
+            delete static_cast<AsyncTransfer *>((*it)->user_data);
+            libusb_free_transfer(*it);
+        }
+        asyncIdleTransfers_.clear();
+        asyncErrcnt_ = 0;
+        asyncErrstr_.clear();
+        if (transport_ != nullptr) {
+            transport_ = nullptr;  // The transport is not owned by this object, and it is simply let go
+        } else {
+            libusb_release_interface(handle_, 0);  // Release the interface
+            if (kernelWasAttached_) {  // If a kernel driver was attached to the interface before
+                libusb_attach_kernel_driver(handle_, 0);  // Reattach the kernel driver
+            }
+            libusb_close(handle_);  // Close the device
+        }
+        trfprioCached_ = false;  // The cached transfer priority is no longer valid, since a different device may be opened next
+        spiModesSet_ = spiDelaysSet_ = gpioModesSet_ = csSet_ = gpioValuesSet_ = 0x0000;  // Likewise, the remembered state must not be restored onto a different device
+        if (!sharedContext_) {
+            context_ = USBContext(nullptr);  // Deinitialize libusb (a shared context is only deinitialized when the last object using it is destroyed)
         }
-        libusb_close(handle_);  // Close the device
-        libusb_exit(context_);  // Deinitialize libusb
         handle_ = nullptr;  // Required to mark the device as closed
     }
 }
 
+// Reports any errors that occurred within asyncTransferCallback(), since the last call to this function or to handleEvents()
+// This is useful when events are handled elsewhere, namely via a USBContext shared by several devices
+void CP2130::collectAsyncErrors(int &errcnt, std::string &errstr)
+{
+    errcnt += asyncErrcnt_;
+    errstr += asyncErrstr_;
+    asyncErrcnt_ = 0;
+    asyncErrstr_.clear();
+}
+
 // Configures the pin mode and value for a given GPIO pin
 // Note that this function can override the GPIO pin modes programmed in the OTP ROM configuration
 void CP2130::configureGPIO(uint8_t pin, uint8_t mode, bool value,  int &errcnt, std::string &errstr)
@@ -280,7 +1099,13 @@ void CP2130::configureGPIO(uint8_t pin, uint8_t mode, bool value,  int &errcnt,
             mode,  // Pin mode (see the values applicable to PinConfig/getPinConfig()/writePinConfig())
             value  // Output value (when applicable)
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_GPIO_MODE_AND_LEVEL, 0x0000, 0x0000, controlBufferOut, SET_GPIO_MODE_AND_LEVEL_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the pin mode and value, so that they can be restored by reconnect()
+            gpioModes_[pin] = mode;
+            gpioModesSet_ = static_cast<uint16_t>(gpioModesSet_ | 1 << pin);
+            gpioValues_ = static_cast<uint16_t>(value ? gpioValues_ | GPIO_BITMAPS[pin] : gpioValues_ & ~GPIO_BITMAPS[pin]);  // The value is restored along with the pin mode
+        }
     }
 }
 
@@ -298,7 +1123,12 @@ void CP2130::configureSPIDelays(uint8_t channel, const SPIDelays &delays, int &e
             static_cast<uint8_t>(delays.pstastdly >> 8), static_cast<uint8_t>(delays.pstastdly),                         // Post-assert delay
             static_cast<uint8_t>(delays.prdastdly >> 8), static_cast<uint8_t>(delays.prdastdly)                          // Pre-deassert delay
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_SPI_DELAY, 0x0000, 0x0000, controlBufferOut, SET_SPI_DELAY_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the delays, so that they can be restored by reconnect()
+            spiDelays_[channel] = delays;
+            spiDelaysSet_ = static_cast<uint16_t>(spiDelaysSet_ | 1 << channel);
+        }
     }
 }
 
@@ -313,7 +1143,12 @@ void CP2130::configureSPIMode(uint8_t channel, const SPIMode &mode, int &errcnt,
             channel,                                                                                       // Selected channel
             static_cast<uint8_t>(mode.cpha << 5 | mode.cpol << 4 | mode.csmode << 3 | (0x07 & mode.cfrq))  // Control word (specified chip select mode, clock frequency, polarity and phase)
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_SPI_WORD, 0x0000, 0x0000, controlBufferOut, SET_SPI_WORD_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the mode, so that it can be restored by reconnect()
+            spiModes_[channel] = mode;
+            spiModesSet_ = static_cast<uint16_t>(spiModesSet_ | 1 << channel);
+        }
     }
 }
 
@@ -323,19 +1158,22 @@ void CP2130::controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t w
     if (!isOpen()) {
         ++errcnt;
         errstr += "In controlTransfer(): device is not open.\n";  // Program logic error
+    } else if (autoReconnect_ && deviceLost_ && !reconnecting_ && !inEventContext_ && !reconnect(errcnt, errstr)) {  // With auto-reconnect enabled, an attempt to reconnect is made before the transfer is issued (except from within a transfer callback)
+        reportError(ETSKIPCONTROL, 0x00, bmRequestType, bRequest, LIBUSB_ERROR_NO_DEVICE, errcnt, errstr);
+    } else if (failFast_ && deviceLost_) {  // In fail-fast mode, no transfers are issued once the device is known to be disconnected, so that no timeouts are incurred
+        reportError(ETSKIPCONTROL, 0x00, bmRequestType, bRequest, LIBUSB_ERROR_NO_DEVICE, errcnt, errstr);
     } else {
-        int result = libusb_control_transfer(handle_, bmRequestType, bRequest, wValue, wIndex, data, wLength, TR_TIMEOUT);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int result = transport_ != nullptr ? transport_->controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeouts_.control) : libusb_control_transfer(handle_, bmRequestType, bRequest, wValue, wIndex, data, wLength, timeouts_.control);
+        recordTransfer(controlStats_[bRequest], result, result, result != wLength, start);
+        if (tracingEnabled_) {
+            recordTrace("control", nullptr, bRequest, wLength, result, start, std::chrono::steady_clock::now());
+        }
         if (result != wLength) {
-            ++errcnt;
-            std::ostringstream stream;
-            stream << "Failed control transfer (0x"
-                   << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(bmRequestType)
-                   << ", 0x"
-                   << std::setw(2) << static_cast<int>(bRequest)
-                   << ")." << std::endl;
-            errstr += stream.str();
+            reportError(ETCONTROL, 0x00, bmRequestType, bRequest, result < 0 ? result : 0, errcnt, errstr);
             if (result == LIBUSB_ERROR_NO_DEVICE || result == LIBUSB_ERROR_IO || result == LIBUSB_ERROR_PIPE) {  // Note that libusb_control_transfer() may return "LIBUSB_ERROR_IO" [-1] or "LIBUSB_ERROR_PIPE" [-9] on device disconnect
                 disconnected_ = true;  // This reports that the device has been disconnected
+                deviceLost_ = deviceLost_ || result == LIBUSB_ERROR_NO_DEVICE;  // Unlike the above, this flag is not set on "LIBUSB_ERROR_IO" or "LIBUSB_ERROR_PIPE", since a stalled request yields the same errors, and would otherwise trip fail-fast mode or automatic reconnection
             }
         }
     }
@@ -352,10 +1190,39 @@ void CP2130::disableCS(uint8_t channel, int &errcnt, std::string &errstr)
             channel,  // Selected channel
             0x00      // Corresponding chip select disabled
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_GPIO_CHIP_SELECT, 0x0000, 0x0000, controlBufferOut, SET_GPIO_CHIP_SELECT_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the chip select state, so that it can be restored by reconnect()
+            csSet_ = static_cast<uint16_t>(csSet_ | 1 << channel);
+            csEnabled_ = static_cast<uint16_t>(csEnabled_ & ~(1 << channel));
+        }
     }
 }
 
+// Disables automatic reconnection
+void CP2130::disableAutoReconnect()
+{
+    autoReconnect_ = false;
+}
+
+// Disables the error ring, so that failed transfers are reported via "errstr" again (any records kept are preserved)
+void CP2130::disableErrorRing()
+{
+    errorRingEnabled_ = false;
+}
+
+// Disables fail-fast mode
+void CP2130::disableFailFast()
+{
+    failFast_ = false;
+}
+
+// Disables the GPIO shadow
+void CP2130::disableGPIOShadow()
+{
+    gpioShadowEnabled_ = false;
+}
+
 // Disables all SPI delays for a given channel
 void CP2130::disableSPIDelays(uint8_t channel, int &errcnt, std::string &errstr)
 {
@@ -370,10 +1237,21 @@ void CP2130::disableSPIDelays(uint8_t channel, int &errcnt, std::string &errstr)
             0x00, 0x00,  // post-assert and
             0x00, 0x00   // pre-deassert delays all set to 0us
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_SPI_DELAY, 0x0000, 0x0000, controlBufferOut, SET_SPI_DELAY_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the delays, so that they can be restored by reconnect()
+            spiDelays_[channel] = SPIDelays();  // All delays disabled
+            spiDelaysSet_ = static_cast<uint16_t>(spiDelaysSet_ | 1 << channel);
+        }
     }
 }
 
+// Disables tracing (the events recorded so far are kept)
+void CP2130::disableTracing()
+{
+    tracingEnabled_ = false;
+}
+
 // Enables the chip select of the target channel
 void CP2130::enableCS(uint8_t channel, int &errcnt, std::string &errstr)
 {
@@ -385,10 +1263,61 @@ void CP2130::enableCS(uint8_t channel, int &errcnt, std::string &errstr)
             channel,  // Selected channel
             0x01      // Corresponding chip select enabled
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_GPIO_CHIP_SELECT, 0x0000, 0x0000, controlBufferOut, SET_GPIO_CHIP_SELECT_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the chip select state, so that it can be restored by reconnect()
+            csSet_ = static_cast<uint16_t>(csSet_ | 1 << channel);
+            csEnabled_ = static_cast<uint16_t>(csEnabled_ | 1 << channel);
+        }
     }
 }
 
+// Enables automatic reconnection, so that any synchronous transfer issued after a disconnect first attempts to reconnect (see reconnect())
+// Asynchronous transfers, as well as synchronous transfers issued from within transfer callbacks, never trigger a reconnection, since reconnect() handles events itself
+// Since the device handle is replaced when reconnecting, automatic reconnection should only be enabled while this object is used from a single thread
+void CP2130::enableAutoReconnect()
+{
+    autoReconnect_ = true;
+}
+
+// Enables the error ring, so that failed transfers are recorded in a bounded ring instead of being reported via "errstr"
+// Each failure still increments "errcnt", but no memory is allocated - The records can be retrieved via errorRecords(), and formatted via errorMessage()
+// Note that program logic errors are still reported via "errstr"
+void CP2130::enableErrorRing()
+{
+    if (errorRing_.empty()) {
+        errorRing_.resize(ERROR_RING_SIZE);  // The ring is allocated only once
+    }
+    errorRingEnabled_ = true;
+}
+
+// Enables fail-fast mode, in which no further transfers are issued once the device is known to be disconnected (see disconnected())
+// Each function that would issue a transfer then fails immediately, instead of waiting for the respective timeout
+// Only errors that unambiguously indicate a disconnect are taken into account: "LIBUSB_ERROR_NO_DEVICE" from any transfer, and "LIBUSB_ERROR_IO" from bulk transfers
+// Thus, a control transfer that fails with "LIBUSB_ERROR_IO" or "LIBUSB_ERROR_PIPE" makes disconnected() return true, but does not trip this mode (the same applies to automatic reconnection)
+void CP2130::enableFailFast()
+{
+    failFast_ = true;
+}
+
+// Enables the GPIO shadow, so that every successful getGPIOs() and setGPIOs() call updates it (write-through)
+void CP2130::enableGPIOShadow()
+{
+    gpioShadowEnabled_ = true;
+}
+
+// Enables tracing, which records the beginning and end of every control and bulk transfer (asynchronous transfers included) in a ring able to hold the given number of events (see traceJSON())
+// The ring is allocated here, so that no memory is allocated while recording, and any events recorded before are discarded
+// Important: this function should not be called while other threads are using the device!
+void CP2130::enableTracing(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(traceMutex_);
+    traceRing_.resize(capacity > 0 ? capacity : 1);
+    traceRecorded_ = 0;
+    traceEpoch_ = std::chrono::steady_clock::now();
+    tracingEnabled_ = true;
+}
+
 // Returns the current clock divider value
 uint8_t CP2130::getClockDivider(int &errcnt, std::string &errstr)
 {
@@ -414,12 +1343,14 @@ bool CP2130::getCS(uint8_t channel, int &errcnt, std::string &errstr)
 }
 
 // Returns the address of the endpoint assuming the IN direction
+// Since the transfer priority is cached, this function does not issue any control transfers, except for the first time (see getTransferPriority())
 uint8_t CP2130::getEndpointInAddr(int &errcnt, std::string &errstr)
 {
     return getTransferPriority(errcnt, errstr) == PRIOWRITE ? 0x82 : 0x81;
 }
 
 // Returns the address of the endpoint assuming the OUT direction
+// Since the transfer priority is cached, this function does not issue any control transfers, except for the first time (see getTransferPriority())
 uint8_t CP2130::getEndpointOutAddr(int &errcnt, std::string &errstr)
 {
     return getTransferPriority(errcnt, errstr) == PRIOWRITE ? 0x01 : 0x02;
@@ -514,9 +1445,22 @@ bool CP2130::getGPIO10(int &errcnt, std::string &errstr)
 // Returns the value of all GPIO pins on the CP2130, in bitmap format
 uint16_t CP2130::getGPIOs(int &errcnt, std::string &errstr)
 {
+    int preverrcnt = errcnt;
     unsigned char controlBufferIn[GET_GPIO_VALUES_WLEN];
     controlTransfer(GET, GET_GPIO_VALUES, 0x0000, 0x0000, controlBufferIn, GET_GPIO_VALUES_WLEN, errcnt, errstr);
-    return static_cast<uint16_t>(BMGPIOS & (controlBufferIn[0] << 8 | controlBufferIn[1]));  // Returns the value of every GPIO pin in bitmap format (big-endian conversion)
+    uint16_t values = static_cast<uint16_t>(BMGPIOS & (controlBufferIn[0] << 8 | controlBufferIn[1]));  // Value of every GPIO pin in bitmap format (big-endian conversion)
+    if (gpioShadowEnabled_ && errcnt == preverrcnt) {
+        gpioShadow_ = values;
+    }
+    return values;
+}
+
+// Returns a snapshot of all GPIO pins on the CP2130, so that any number of pins can be queried at the cost of a single control transfer
+CP2130::GPIOSnapshot CP2130::getGPIOSnapshot(int &errcnt, std::string &errstr)
+{
+    GPIOSnapshot snapshot;
+    snapshot.values = getGPIOs(errcnt, errstr);
+    return snapshot;
 }
 
 // Returns the lock word from the CP2130 OTP ROM
@@ -637,14 +1581,19 @@ CP2130::SPIMode CP2130::getSPIMode(uint8_t channel, int &errcnt, std::string &er
 }
 
 // Returns the transfer priority from the CP2130 OTP ROM
+// The transfer priority is read when the device is opened and cached from then on, so that the endpoint addresses can be deduced without any overhead
 uint8_t CP2130::getTransferPriority(int &errcnt, std::string &errstr)
 {
-    return getUSBConfig(errcnt, errstr).trfprio;  // Refactored in version 1.1.0, because the overhead presented by this solution was found to be very slim
+    if (!trfprioCached_) {  // The cached value is only missing if it could not be read when the device was opened, or after writeUSBConfig() changes the transfer priority
+        getUSBConfig(errcnt, errstr);  // This caches the transfer priority, if successful
+    }
+    return trfprio_;
 }
 
 // Gets the USB configuration, including VID, PID, major and minor release versions, from the CP2130 OTP ROM
 CP2130::USBConfig CP2130::getUSBConfig(int &errcnt, std::string &errstr)
 {
+    int preverrcnt = errcnt;
     unsigned char controlBufferIn[GET_USB_CONFIG_WLEN];
     controlTransfer(GET, GET_USB_CONFIG, 0x0000, 0x0000, controlBufferIn, GET_USB_CONFIG_WLEN, errcnt, errstr);
     USBConfig config;
@@ -655,9 +1604,30 @@ CP2130::USBConfig CP2130::getUSBConfig(int &errcnt, std::string &errstr)
     config.maxpow = controlBufferIn[4];                                                // Maximum power consumption corresponds to byte 4
     config.powmode = controlBufferIn[5];                                               // Power mode corresponds to byte 5
     config.trfprio = controlBufferIn[8];                                               // Transfer priority corresponds to byte 8
+    if (errcnt == preverrcnt) {  // Since the USB configuration was read anyway, the cached transfer priority is updated
+        trfprio_ = config.trfprio;
+        trfprioCached_ = true;
+    }
     return config;
 }
 
+// Handles pending USB events, calling the completion callbacks of any transfers submitted via bulkTransferAsync() that meanwhile completed
+// This function blocks until at least one event is handled, or until the transfer timeout expires
+void CP2130::handleEvents(int &errcnt, std::string &errstr)
+{
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In handleEvents(): device is not open.\n";  // Program logic error
+    } else {
+        timeval timeout = {TR_TIMEOUT / 1000, 1000 * (TR_TIMEOUT % 1000)};
+        if (handleEventsTimeout(&timeout) != 0) {
+            ++errcnt;
+            errstr += "Failed to handle USB events.\n";
+        }
+        collectAsyncErrors(errcnt, errstr);
+    }
+}
+
 // Returns true is the OTP ROM of the CP2130 was never written
 bool CP2130::isOTPBlank(int &errcnt, std::string &errstr)
 {
@@ -691,44 +1661,115 @@ int CP2130::open(uint16_t vid, uint16_t pid, const std::string &serial)
     int retval;
     if (isOpen()) {  // Just in case the calling algorithm tries to open a device that was already sucessfully open, or tries to open different devices concurrently, all while using (or referencing to) the same object
         retval = SUCCESS;
-    } else if (libusb_init(&context_) != 0) {  // Initialize libusb. In case of failure
-        retval = ERROR_INIT;
-    } else {  // If libusb is initialized
-        if (serial.empty()) {  // Note that serial, by omission, is an empty string
-            handle_ = libusb_open_device_with_vid_pid(context_, vid, pid);  // If no serial number is specified, this will open the first device found with matching VID and PID
-        } else {
-            char *serialcstr = new char[serial.size() + 1];  // Allocated dynamically since version 1.1.0
-            std::strcpy(serialcstr, serial.c_str());
-            handle_ = libusb_open_device_with_vid_pid_serial(context_, vid, pid, reinterpret_cast<unsigned char *>(serialcstr));
-            delete[] serialcstr;
+    } else {
+        if (!sharedContext_) {
+            context_ = USBContext();  // Initialize libusb
         }
-        if (handle_ == nullptr) {  // If the previous operation fails to get a device handle
-            libusb_exit(context_);  // Deinitialize libusb
-            retval = ERROR_NOT_FOUND;
-        } else {  // If the device is successfully opened and a handle obtained
-            if (libusb_kernel_driver_active(handle_, 0) == 1) {  // If a kernel driver is active on the interface
-                libusb_detach_kernel_driver(handle_, 0);  // Detach the kernel driver
-                kernelWasAttached_ = true;  // Flag that the kernel driver was attached
+        if (context_.isNull()) {  // In case of failure
+            retval = ERROR_INIT;
+        } else {  // If libusb is initialized
+            if (sharedContext_) {
+                handle_ = context_.openDevice(vid, pid, serial);  // The device list cached by the shared context is used, instead of enumerating devices again
+            } else if (serial.empty()) {  // Note that serial, by omission, is an empty string
+                handle_ = libusb_open_device_with_vid_pid(context_.get(), vid, pid);  // If no serial number is specified, this will open the first device found with matching VID and PID
             } else {
-                kernelWasAttached_ = false;  // The kernel driver was not attached
+                char *serialcstr = new char[serial.size() + 1];  // Allocated dynamically since version 1.1.0
+                std::strcpy(serialcstr, serial.c_str());
+                handle_ = libusb_open_device_with_vid_pid_serial(context_.get(), vid, pid, reinterpret_cast<unsigned char *>(serialcstr));
+                delete[] serialcstr;
             }
-            if (libusb_claim_interface(handle_, 0) != 0) {  // Claim the interface. In case of failure
-                if (kernelWasAttached_) {  // If a kernel driver was attached to the interface before
-                    libusb_attach_kernel_driver(handle_, 0);  // Reattach the kernel driver
+            if (handle_ == nullptr) {  // If the previous operation fails to get a device handle
+                retval = ERROR_NOT_FOUND;
+            } else {  // If the device is successfully opened and a handle obtained
+                if (!claimInterface(handle_)) {  // Claim the interface. In case of failure
+                    libusb_close(handle_);  // Close the device
+                    handle_ = nullptr;  // Required to mark the device as closed
+                    retval = ERROR_BUSY;
+                } else {
+                    disconnected_ = deviceLost_ = false;  // Note that this flag is never assumed to be true for a device that was never opened - See constructor for details!
+                    rememberLocation();  // Required by reconnect()
+                    int errcnt = 0;
+                    std::string errstr;
+                    getUSBConfig(errcnt, errstr);  // Read and cache the transfer priority, from which the endpoint addresses are deduced (if this fails, it is read again on demand)
+                    retval = SUCCESS;
                 }
-                libusb_close(handle_);  // Close the device
-                libusb_exit(context_);  // Deinitialize libusb
-                handle_ = nullptr;  // Required to mark the device as closed
-                retval = ERROR_BUSY;
-            } else {
-                disconnected_ = false;  // Note that this flag is never assumed to be true for a device that was never opened - See constructor for details!
-                retval = SUCCESS;
             }
         }
+        if (retval != SUCCESS && !sharedContext_) {
+            context_ = USBContext(nullptr);  // Deinitialize libusb
+        }
     }
     return retval;
 }
 
+// Opens the device behind the given transport, through which all transfers are then issued instead of libusb (e.g., a CP2130Simulator object)
+// The transport is not owned by this object, and it must remain valid until the device is closed
+int CP2130::open(CP2130Transport &transport)
+{
+    if (!isOpen()) {
+        transport_ = &transport;
+        disconnected_ = deviceLost_ = false;
+        int errcnt = 0;
+        std::string errstr;
+        getUSBConfig(errcnt, errstr);  // Read and cache the transfer priority, as it is done for devices opened via libusb
+    }
+    return SUCCESS;
+}
+
+// Reopens the device at the same bus and port path where it was last opened, provided that it has the same serial number, and returns true if successful
+// The SPI modes and delays, chip selects, and GPIO modes and values that were successfully applied via this object are then restored
+// Note that any transfers in flight are cancelled, and that the old handle is closed only once the device is reopened
+// This function must not be called from within a transfer callback, nor while another thread is using this object
+bool CP2130::reconnect(int &errcnt, std::string &errstr)
+{
+    bool reconnected = false;
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In reconnect(): device is not open.\n";  // Program logic error
+    } else if (reconnecting_) {
+        ++errcnt;
+        errstr += "In reconnect(): a reconnection is already in progress.\n";  // Program logic error
+    } else if (inEventContext_) {
+        ++errcnt;
+        errstr += "In reconnect(): cannot reconnect from within a transfer callback.\n";  // Program logic error
+    } else if (transport_ != nullptr) {
+        ++errcnt;
+        errstr += "In reconnect(): device was opened via a transport.\n";  // Program logic error
+    } else {
+        reconnecting_ = true;  // Prevents any transfers issued while restoring the state from attempting to reconnect again
+        bool kernelWasAttached = kernelWasAttached_;
+        libusb_device_handle *handle = context_.openDeviceAt(bus_, ports_);
+        if (handle != nullptr && serialNumber(handle) != serial_) {  // If a different device is found at the same location
+            libusb_close(handle);
+            handle = nullptr;
+        }
+        if (handle == nullptr || !claimInterface(handle)) {  // If the device could not be reopened or its interface could not be claimed
+            if (handle != nullptr) {
+                libusb_close(handle);
+            }
+            kernelWasAttached_ = kernelWasAttached;  // This still refers to the old handle
+            ++errcnt;
+            errstr += "Could not reconnect to device.\n";
+        } else {
+            cancelAsyncTransfers();  // Any transfers still in flight on the old handle must be cancelled and reaped
+            timeval timeout = {TR_TIMEOUT / 1000, 1000 * (TR_TIMEOUT % 1000)};
+            while (!asyncTransfers_.empty() && handleEventsTimeout(&timeout) == 0) {
+            }
+            asyncErrcnt_ = 0;
+            asyncErrstr_.clear();
+            libusb_release_interface(handle_, 0);
+            libusb_close(handle_);  // The kernel driver is not reattached, since the old handle refers to a device that is gone
+            handle_ = handle;
+            disconnected_ = deviceLost_ = false;
+            trfprioCached_ = false;  // The transfer priority is read again on demand
+            restoreState(errcnt, errstr);
+            reconnected = true;
+        }
+        reconnecting_ = false;
+    }
+    return reconnected;
+}
+
 // Issues a reset to the CP2130
 void CP2130::reset(int &errcnt, std::string &errstr)
 {
@@ -746,7 +1787,23 @@ void CP2130::selectCS(uint8_t channel, int &errcnt, std::string &errstr)
             channel,  // Selected channel
             0x02      // Only the corresponding chip select is enabled, all the others are disabled
         };
+        int preverrcnt = errcnt;
         controlTransfer(SET, SET_GPIO_CHIP_SELECT, 0x0000, 0x0000, controlBufferOut, SET_GPIO_CHIP_SELECT_WLEN, errcnt, errstr);
+        if (errcnt == preverrcnt) {  // Remember the chip select state, so that it can be restored by reconnect() (the state of every channel is now known)
+            csSet_ = 0x07ff;
+            csEnabled_ = static_cast<uint16_t>(1 << channel);
+        }
+    }
+}
+
+// Sets the number of IN transfers (or WriteRead commands) that are kept in flight by spiReadAsync(), spiReadWithRTR() and spiWriteRead()
+void CP2130::setAsyncQueueDepth(size_t depth, int &errcnt, std::string &errstr)
+{
+    if (depth < 1 || depth > ASYNC_QUEUE_MAXDEPTH) {
+        ++errcnt;
+        errstr += "In setAsyncQueueDepth(): queue depth must be between 1 and 32.\n";  // Program logic error
+    } else {
+        asyncQueueDepth_ = depth;
     }
 }
 
@@ -851,12 +1908,28 @@ void CP2130::setGPIOs(uint16_t bmValues, uint16_t bmMask, int &errcnt, std::stri
         static_cast<uint8_t>((BMGPIOS & bmValues) >> 8), static_cast<uint8_t>(BMGPIOS & bmValues),  // GPIO values bitmap
         static_cast<uint8_t>((BMGPIOS & bmMask) >> 8), static_cast<uint8_t>(BMGPIOS & bmMask)       // Mask bitmap
     };
+    int preverrcnt = errcnt;
     controlTransfer(SET, SET_GPIO_VALUES, 0x0000, 0x0000, controlBufferOut, SET_GPIO_VALUES_WLEN, errcnt, errstr);
+    if (gpioShadowEnabled_ && errcnt == preverrcnt) {
+        gpioShadow_ = static_cast<uint16_t>((gpioShadow_ & ~bmMask) | (BMGPIOS & bmValues & bmMask));  // Only the masked pins are updated
+    }
+    if (errcnt == preverrcnt) {  // Remember the values of the masked pins, so that they can be restored by reconnect()
+        gpioValues_ = static_cast<uint16_t>((gpioValues_ & ~bmMask) | (BMGPIOS & bmValues & bmMask));
+        gpioValuesSet_ = static_cast<uint16_t>(gpioValuesSet_ | (BMGPIOS & bmMask));
+    }
 }
 
-// Requests and reads the given number of bytes from the SPI bus, and then returns a vector
-// This is the prefered method of reading from the bus, if both endpoint addresses are known
-std::vector<uint8_t> CP2130::spiRead(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr)
+// Sets the timeouts applicable to each type of transfer (all default to 500ms)
+// A shorter timeout makes failures on a disconnected device faster to detect, at the risk of aborting legitimate transfers - A timeout of zero means no timeout
+void CP2130::setTimeouts(const Timeouts &timeouts)
+{
+    timeouts_ = timeouts;
+}
+
+// Requests and reads the given number of bytes from the SPI bus into the given buffer, and then returns the number of bytes actually read
+// Since the buffer is owned by the caller, this function does not allocate any memory, and it is the prefered method of reading from the bus on hot paths
+// Important: the buffer must be able to hold at least "bytesToRead" bytes!
+size_t CP2130::spiRead(uint8_t *data, uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr)
 {
     unsigned char readCommandBuffer[8] = {
         0x00, 0x00,    // Reserved
@@ -873,23 +1946,63 @@ std::vector<uint8_t> CP2130::spiRead(uint32_t bytesToRead, uint8_t endpointInAdd
     int bytesWritten;
     bulkTransfer(endpointOutAddr, readCommandBuffer, static_cast<int>(sizeof(readCommandBuffer)), &bytesWritten, errcnt, errstr);
 #endif
-    unsigned char *readInputBuffer = new unsigned char[bytesToRead];  // Allocated dynamically since version 1.1.0
     int bytesRead = 0;  // Important!
-    bulkTransfer(endpointInAddr, readInputBuffer, static_cast<int>(bytesToRead), &bytesRead, errcnt, errstr);
-    std::vector<uint8_t> retdata(static_cast<size_t>(bytesRead));
-    for (int i = 0; i < bytesRead; ++i) {
-        retdata[i] = readInputBuffer[i];
-    }
-    delete[] readInputBuffer;
+    bulkTransfer(endpointInAddr, data, static_cast<int>(bytesToRead), &bytesRead, errcnt, errstr);
+    return static_cast<size_t>(bytesRead);
+}
+
+// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced from the cached transfer priority)
+size_t CP2130::spiRead(uint8_t *data, uint32_t bytesToRead, int &errcnt, std::string &errstr)
+{
+    return spiRead(data, bytesToRead, getEndpointInAddr(errcnt, errstr), getEndpointOutAddr(errcnt, errstr), errcnt, errstr);
+}
+
+// Requests and reads the given number of bytes from the SPI bus, and then returns a vector
+// This is the prefered method of reading from the bus, if both endpoint addresses are known
+std::vector<uint8_t> CP2130::spiRead(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr)
+{
+    std::vector<uint8_t> retdata(static_cast<size_t>(bytesToRead));
+    retdata.resize(spiRead(retdata.data(), bytesToRead, endpointInAddr, endpointOutAddr, errcnt, errstr));  // The data is read directly into the vector, which is then shrunk to the number of bytes actually read (this involves no reallocation)
     return retdata;
 }
 
-// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced, at the cost of decreased speed)
+// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced from the cached transfer priority)
 std::vector<uint8_t> CP2130::spiRead(uint32_t bytesToRead, int &errcnt, std::string &errstr)
 {
     return spiRead(bytesToRead, getEndpointInAddr(errcnt, errstr), getEndpointOutAddr(errcnt, errstr), errcnt, errstr);
 }
 
+// Requests the given number of bytes from the SPI bus, and then reads them while keeping several IN transfers in flight, so that the CP2130 FIFO never waits for the host
+// The received data is passed to the given callback, chunk by chunk and in order, and the total number of bytes read is returned
+// This is the prefered method of performing long reads, if both endpoint addresses are known
+size_t CP2130::spiReadAsync(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, const ReadCallback &callback, int &errcnt, std::string &errstr)
+{
+    return readStream(READ, bytesToRead, endpointInAddr, endpointOutAddr, timeouts_.bulkIn, [&callback](const uint8_t *data, size_t length) {
+        callback(data, length);
+        return true;
+    }, errcnt, errstr);
+}
+
+// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced from the cached transfer priority)
+size_t CP2130::spiReadAsync(uint32_t bytesToRead, const ReadCallback &callback, int &errcnt, std::string &errstr)
+{
+    return spiReadAsync(bytesToRead, getEndpointInAddr(errcnt, errstr), getEndpointOutAddr(errcnt, errstr), callback, errcnt, errstr);
+}
+
+// Issues a ReadWithRTR command and continuously drains the IN endpoint into the given sink, while the RTR input allows the CP2130 to read from the SPI bus
+// Streaming ends when the given number of bytes is received, when the sink returns false, or when stopRTR() is called (either from within the sink or from another thread), and the number of bytes read is returned
+// Note that GPIO.3 must be configured as an RTR or !RTR input (see PCRTR and PCNRTR), and that the IN transfers never time out while waiting for RTR to become active
+size_t CP2130::spiReadWithRTR(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, const SinkCallback &sink, int &errcnt, std::string &errstr)
+{
+    return readStream(READWITHRTR, bytesToRead, endpointInAddr, endpointOutAddr, 0, sink, errcnt, errstr);
+}
+
+// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced from the cached transfer priority)
+size_t CP2130::spiReadWithRTR(uint32_t bytesToRead, const SinkCallback &sink, int &errcnt, std::string &errstr)
+{
+    return spiReadWithRTR(bytesToRead, getEndpointInAddr(errcnt, errstr), getEndpointOutAddr(errcnt, errstr), sink, errcnt, errstr);
+}
+
 // Writes to the SPI bus, using the given vector
 // This is the prefered method of writing to the bus, if the endpoint OUT address is known
 void CP2130::spiWrite(const std::vector<uint8_t> &data, uint8_t endpointOutAddr, int &errcnt, std::string &errstr)
@@ -917,70 +2030,147 @@ void CP2130::spiWrite(const std::vector<uint8_t> &data, uint8_t endpointOutAddr,
     delete[] writeCommandBuffer;
 }
 
-// This function is a shorthand version of the previous one (the endpoint OUT address is automatically deduced at the cost of decreased speed)
+// This function is a shorthand version of the previous one (the endpoint OUT address is automatically deduced from the cached transfer priority)
 void CP2130::spiWrite(const std::vector<uint8_t> &data, int &errcnt, std::string &errstr)
 {
     spiWrite(data, getEndpointOutAddr(errcnt, errstr), errcnt, errstr);
 }
 
 // Writes to the SPI bus while reading back, returning a vector of the same size as the one given
+// The data is split into WriteRead commands of up to 56 bytes each, and several of these are kept in flight on both endpoints (see setAsyncQueueDepth())
 // This is the prefered method of writing and reading, if both endpoint addresses are known
 std::vector<uint8_t> CP2130::spiWriteRead(const std::vector<uint8_t> &data, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr)
 {
-    size_t bytesToWriteRead = data.size();
-    size_t bytesProcessed = 0;  // Loop control variable implemented in version 1.2.3, to replace "bytesLeft"
     std::vector<uint8_t> retdata;
-    int preverrcnt = errcnt;
-    while (bytesProcessed < bytesToWriteRead && preverrcnt == errcnt) {  // The extra condition breaks the loop in case of error (added in version 1.2.4)
-        size_t bytesRemaining = bytesToWriteRead - bytesProcessed;  // Equivalent to the variable "bytesLeft" found in version 1.2.2, except that it is no longer used for control
-        uint32_t payload = static_cast<uint32_t>(bytesRemaining > 56 ? 56 : bytesRemaining);
-        int bufSize = payload + 8;
-        unsigned char *writeReadCommandBuffer = new unsigned char[bufSize] {
-            0x00, 0x00,         // Reserved
-            CP2130::WRITEREAD,  // WriteRead command
-            0x00,               // Reserved
-            static_cast<uint8_t>(payload),
-            static_cast<uint8_t>(payload >> 8),
-            static_cast<uint8_t>(payload >> 16),
-            static_cast<uint8_t>(payload >> 24)
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In spiWriteRead(): device is not open.\n";  // Program logic error
+    } else {
+        size_t bytesToWriteRead = data.size();
+        size_t nchunks = (bytesToWriteRead + WRCHUNK_SIZE - 1) / WRCHUNK_SIZE;
+        std::vector<unsigned char> writeReadCommandBuffer(8 * nchunks + bytesToWriteRead);  // Every command packet is built in advance, so that only one allocation is needed
+        for (size_t i = 0; i < nchunks; ++i) {
+            size_t bytesProcessed = WRCHUNK_SIZE * i;
+            size_t bytesRemaining = bytesToWriteRead - bytesProcessed;
+            uint32_t payload = static_cast<uint32_t>(bytesRemaining > WRCHUNK_SIZE ? WRCHUNK_SIZE : bytesRemaining);
+            unsigned char *command = &writeReadCommandBuffer[(WRCHUNK_SIZE + 8) * i];
+            command[0] = 0x00;  // Reserved
+            command[1] = 0x00;  // Reserved
+            command[2] = CP2130::WRITEREAD;  // WriteRead command
+            command[3] = 0x00;  // Reserved
+            command[4] = static_cast<uint8_t>(payload);
+            command[5] = static_cast<uint8_t>(payload >> 8);
+            command[6] = static_cast<uint8_t>(payload >> 16);
+            command[7] = static_cast<uint8_t>(payload >> 24);
+            std::memcpy(command + 8, &data[bytesProcessed], payload);
+        }
+        retdata.resize(bytesToWriteRead);  // The IN transfers write directly into the returned vector, each chunk at its own offset, so that byte order is preserved
+        size_t nextChunk = 0;
+        size_t bytesRead = 0;
+        size_t inFlight = 0;
+        bool failed = false;
+        std::function<void(size_t)> submitChunk;
+        std::function<int(size_t)> chunkPayload = [&](size_t chunk) {
+            size_t bytesRemaining = bytesToWriteRead - WRCHUNK_SIZE * chunk;
+            return static_cast<int>(bytesRemaining > WRCHUNK_SIZE ? WRCHUNK_SIZE : bytesRemaining);
+        };
+        std::function<void(const char *, size_t)> reportChunk = [&](const char *action, size_t chunk) {  // Only used for failures that asyncTransferCallback() does not report (i.e., short or cancelled transfers)
+            ++errcnt;
+            std::ostringstream stream;
+            stream << "In spiWriteRead(): failed to " << action << " chunk " << chunk
+                   << " (bytes " << WRCHUNK_SIZE * chunk << " to " << WRCHUNK_SIZE * chunk + chunkPayload(chunk) - 1 << ")." << std::endl;
+            errstr += stream.str();
         };
-        for (size_t i = 0; i < payload; ++i) {
-            writeReadCommandBuffer[i + 8] = data[bytesProcessed + i];
+        AsyncCallback readCallback = [&](int status, unsigned char *chunkData, int transferred) {  // Shared by every IN transfer, which is identified by the address of its data, so that no callback is allocated per transfer
+            --inFlight;
+            if (!failed) {  // Chunks that complete after the first failure are discarded, since their data would no longer be in sequence
+                size_t chunk = static_cast<size_t>(chunkData - &retdata[0]) / WRCHUNK_SIZE;
+                if (status == LIBUSB_TRANSFER_COMPLETED && transferred == chunkPayload(chunk)) {
+                    bytesRead += static_cast<size_t>(transferred);
+                    if (nextChunk < nchunks) {
+                        submitChunk(nextChunk++);  // A chunk was fully read back, so another one may be put in flight
+                    }
+                } else {
+                    if (status == LIBUSB_TRANSFER_COMPLETED) {  // Short read
+                        bytesRead += static_cast<size_t>(transferred);
+                        reportChunk("read back", chunk);
+                    } else if (status == LIBUSB_TRANSFER_CANCELLED) {  // Cancelled elsewhere (e.g., by a callback of another transfer)
+                        reportChunk("read back", chunk);
+                    }
+                    failed = true;
+                    cancelAsyncTransfers();
+                }
+            }
+        };
+        AsyncCallback writeCallback = [&](int status, unsigned char *chunkData, int transferred) {  // Shared by every OUT transfer, likewise
+            --inFlight;
+            if (!failed) {
+                size_t chunk = static_cast<size_t>(chunkData - &writeReadCommandBuffer[0]) / (WRCHUNK_SIZE + 8);
+                if (status != LIBUSB_TRANSFER_COMPLETED || transferred != chunkPayload(chunk) + 8) {
+                    if (status == LIBUSB_TRANSFER_COMPLETED || status == LIBUSB_TRANSFER_CANCELLED) {  // Other failures are already reported by asyncTransferCallback()
+                        reportChunk("write", chunk);
+                    }
+                    failed = true;
+                    cancelAsyncTransfers();
+                }
+            }
+        };
+        submitChunk = [&](size_t chunk) {
+            int payload = chunkPayload(chunk);
+            int preverrcnt = errcnt;
+            submitAsyncTransfer(endpointInAddr, &retdata[WRCHUNK_SIZE * chunk], payload, timeouts_.bulkIn, readCallback, false, errcnt, errstr);
+            if (errcnt == preverrcnt) {
+                ++inFlight;
+                submitAsyncTransfer(endpointOutAddr, &writeReadCommandBuffer[(WRCHUNK_SIZE + 8) * chunk], payload + 8, timeouts_.bulkOut, writeCallback, false, errcnt, errstr);
+                if (errcnt == preverrcnt) {
+                    ++inFlight;
+                }
+            }
+            if (errcnt != preverrcnt && !failed) {
+                failed = true;
+                cancelAsyncTransfers();
+            }
+        };
+        while (nextChunk < nchunks && nextChunk < asyncQueueDepth_ && !failed) {
+            submitChunk(nextChunk++);
         }
-#if LIBUSB_API_VERSION >= 0x01000105
-        bulkTransfer(endpointOutAddr, writeReadCommandBuffer, bufSize, nullptr, errcnt, errstr);
-#else
-        int bytesWritten;
-        bulkTransfer(endpointOutAddr, writeReadCommandBuffer, bufSize, &bytesWritten, errcnt, errstr);
-#endif
-        delete[] writeReadCommandBuffer;
-        unsigned char *writeReadInputBuffer = new unsigned char[payload];
-        int bytesRead = 0;  // Important!
-        bulkTransfer(endpointInAddr, writeReadInputBuffer, payload, &bytesRead, errcnt, errstr);
-        size_t prevretdataSize = retdata.size();
-        retdata.resize(static_cast<size_t>(prevretdataSize + bytesRead));  // Optimization implemented in version 1.2.2, and fixed in version 1.2.3
-        for (int i = 0; i < bytesRead; ++i) {
-            retdata[prevretdataSize + i] = writeReadInputBuffer[i];  // Note that std::vector::push_back() is no longer used since version 1.2.2, because it is more efficient to resize the vector only once per iteration (see above), so that the values may be simply assigned (fixed in version 1.2.3)
+        while (inFlight > 0) {  // Note that the local variables referenced by the callbacks must remain valid until every transfer is reaped
+            int preverrcnt = errcnt;
+            handleEvents(errcnt, errstr);
+            if (errcnt != preverrcnt && !failed) {
+                failed = true;
+                cancelAsyncTransfers();
+            }
         }
-        delete[] writeReadInputBuffer;
-        bytesProcessed += payload;  // Note that, since version 1.2.3, the loop control variable is added to (it is generaly a bad idea to subtract from a unsigned variable, because it can lead to a overflow that may go unchecked)
+        retdata.resize(bytesRead);  // In case of error, only the bytes that were read back in sequence are returned
     }
     return retdata;
 }
 
-// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced, at the cost of decreased speed)
+// This function is a shorthand version of the previous one (both endpoint addresses are automatically deduced from the cached transfer priority)
 std::vector<uint8_t> CP2130::spiWriteRead(const std::vector<uint8_t> &data, int &errcnt, std::string &errstr)
 {
     return spiWriteRead(data, getEndpointInAddr(errcnt, errstr), getEndpointOutAddr(errcnt, errstr), errcnt, errstr);
 }
 
 // Aborts the current ReadWithRTR command
+// If called while spiReadWithRTR() is running, either from within the sink or from another thread, the stop is only requested here: the streaming thread then cancels the IN transfers that are still waiting for data and aborts the command once its event loop returns
 void CP2130::stopRTR(int &errcnt, std::string &errstr)
 {
-    unsigned char controlBufferOut[SET_RTR_STOP_WLEN] = {
-        0x01  // Abort current ReadWithRTR command
-    };
-    controlTransfer(SET, SET_RTR_STOP, 0x0000, 0x0000, controlBufferOut, SET_RTR_STOP_WLEN, errcnt, errstr);
+    bool deferred;
+    {
+        std::lock_guard<std::mutex> lock(streamMutex_);
+        deferred = streaming_;
+        if (deferred) {
+            rtrStopRequested_ = true;
+        }
+    }
+    if (!deferred) {
+        unsigned char controlBufferOut[SET_RTR_STOP_WLEN] = {
+            0x01  // Abort current ReadWithRTR command
+        };
+        controlTransfer(SET, SET_RTR_STOP, 0x0000, 0x0000, controlBufferOut, SET_RTR_STOP_WLEN, errcnt, errstr);
+    }
 }
 
 // This procedure is used to lock fields in the CP2130 OTP ROM - Use with care!
@@ -1074,38 +2264,144 @@ void CP2130::writeUSBConfig(const USBConfig &config, uint8_t mask, int &errcnt,
         mask                                                                      // Write mask (can be obtained using the return value of getLockWord(), after being bitwise ANDed with "LWUSBCFG" [0x009f] and the resulting value cast to uint8_t)
     };
     controlTransfer(SET, SET_USB_CONFIG, PROM_WRITE_KEY, 0x0000, controlBufferOut, SET_USB_CONFIG_WLEN, errcnt, errstr);
+    if ((LWTRFPRIO & mask) != 0x00) {  // If the transfer priority is written, the cached value (and therefore the endpoint addresses) must be read again
+        trfprioCached_ = false;
+    }
+}
+
+// Helper function to enumerate devices, returning a record for each one
+std::vector<CP2130::DeviceInfo> CP2130::enumerateDevices(uint16_t vid, uint16_t pid, bool parallel, int &errcnt, std::string &errstr)
+{
+    std::vector<DeviceInfo> devices;
+    USBContext context;  // Initialize libusb (libusb is deinitialized as soon as the context goes out of scope)
+    if (context.isNull()) {  // In case of failure
+        ++errcnt;
+        errstr += "Could not initialize libusb.\n";
+    } else {  // If libusb is initialized
+        devices = enumerateDevices(context, vid, pid, parallel, errcnt, errstr);
+    }
+    return devices;
+}
+
+// Helper function to enumerate devices, using the device list cached by the given context
+// Each device is opened only once, and its serial number, location, USB configuration and silicon version are all read at that time
+// If "parallel" is true, the devices are queried concurrently, using one thread per device
+std::vector<CP2130::DeviceInfo> CP2130::enumerateDevices(const USBContext &context, uint16_t vid, uint16_t pid, bool parallel, int &errcnt, std::string &errstr)
+{
+    struct Query {
+        DeviceInfo info;
+        bool queried;
+        int errcnt;
+        std::string errstr;
+    };
+    std::vector<libusb_device *> devs = context.getDevices(vid, pid, errcnt, errstr);  // Get the devices having matching VID and PID
+    std::vector<Query> queries(devs.size());
+    std::function<void(size_t)> query = [&devs, &queries](size_t i) {  // Each call only accesses its own device and query
+        queries[i].queried = false;
+        queries[i].errcnt = 0;
+        libusb_device_descriptor desc;
+        libusb_device_handle *handle;
+        if (libusb_get_device_descriptor(devs[i], &desc) == 0 && libusb_open(devs[i], &handle) == 0) {  // Open the listed device. If successfull
+            unsigned char str_desc[256];
+            if (libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, str_desc, static_cast<int>(sizeof(str_desc))) >= 0) {  // Get the serial number string in ASCII format
+                DeviceInfo &info = queries[i].info;
+                info.serial = reinterpret_cast<char *>(str_desc);
+                info.bus = libusb_get_bus_number(devs[i]);
+                uint8_t ports[USBContext::MAX_PORT_DEPTH];
+                int nports = libusb_get_port_numbers(devs[i], ports, USBContext::MAX_PORT_DEPTH);
+                info.ports.assign(ports, ports + (nports > 0 ? nports : 0));
+                info.address = libusb_get_device_address(devs[i]);
+                queryDevice(handle, info, queries[i].errcnt, queries[i].errstr);
+                queries[i].queried = true;
+            }
+            libusb_close(handle);  // Close the device
+        }
+    };
+    if (parallel) {
+        std::vector<std::future<void>> futures;
+        futures.reserve(devs.size());
+        for (size_t i = 0; i < devs.size(); ++i) {
+            futures.push_back(std::async(std::launch::async, query, i));
+        }
+        for (size_t i = 0; i < futures.size(); ++i) {
+            futures[i].get();
+        }
+    } else {
+        for (size_t i = 0; i < devs.size(); ++i) {
+            query(i);
+        }
+    }
+    USBContext::freeDevices(devs);
+    std::vector<DeviceInfo> devices;
+    for (size_t i = 0; i < queries.size(); ++i) {  // The records and any errors are gathered in enumeration order
+        errcnt += queries[i].errcnt;
+        errstr += queries[i].errstr;
+        if (queries[i].queried) {
+            devices.push_back(queries[i].info);
+        }
+    }
+    return devices;
+}
+
+// Helper function that returns the message corresponding to the given error record, exactly as it would be appended to "errstr" if the error ring was disabled
+std::string CP2130::errorMessage(const ErrorRecord &record)
+{
+    std::ostringstream stream;
+    if (record.type == ETCONTROL) {
+        stream << "Failed control transfer (0x"
+               << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.bmRequestType)
+               << ", 0x"
+               << std::setw(2) << static_cast<int>(record.bRequest)
+               << ")." << std::endl;
+    } else if (record.type == ETSKIPCONTROL) {
+        stream << "Skipped control transfer (0x"
+               << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.bmRequestType)
+               << ", 0x"
+               << std::setw(2) << static_cast<int>(record.bRequest)
+               << "), since the device is disconnected." << std::endl;
+    } else if (record.type == ETSKIPBULK) {
+        stream << "Skipped bulk transfer (address 0x"
+               << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.endpointAddr)
+               << "), since the device is disconnected." << std::endl;
+    } else if (record.type == ETASYNCSUBMIT) {
+        stream << "Failed to submit asynchronous bulk transfer (address 0x"
+               << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.endpointAddr)
+               << ")." << std::endl;
+    } else {
+        const char *kind = record.type == ETASYNC ? "Failed asynchronous bulk " : "Failed bulk ";
+        if (record.endpointAddr < 0x80) {
+            stream << kind << "OUT transfer to endpoint "
+                   << (0x0f & record.endpointAddr)
+                   << " (address 0x"
+                   << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.endpointAddr)
+                   << ")." << std::endl;
+        } else {
+            stream << kind << "IN transfer from endpoint "
+                   << (0x0f & record.endpointAddr)
+                   << " (address 0x"
+                   << std::hex << std::setfill ('0') << std::setw(2) << static_cast<int>(record.endpointAddr)
+                   << ")." << std::endl;
+        }
+    }
+    return stream.str();
 }
 
 // Helper function to list devices
 std::list<std::string> CP2130::listDevices(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr)
 {
     std::list<std::string> devices;
-    libusb_context *context;
-    if (libusb_init(&context) != 0) {  // Initialize libusb. In case of failure
+    USBContext context;  // Initialize libusb (libusb is deinitialized as soon as the context goes out of scope)
+    if (context.isNull()) {  // In case of failure
         ++errcnt;
         errstr += "Could not initialize libusb.\n";
     } else {  // If libusb is initialized
-        libusb_device **devs;
-        ssize_t devlist = libusb_get_device_list(context, &devs);  // Get a device list
-        if (devlist < 0) {  // If the previous operation fails to get a device list
-            ++errcnt;
-            errstr += "Failed to retrieve a list of devices.\n";
-        } else {
-            for (ssize_t i = 0; i < devlist; ++i) {  // Run through all listed devices
-                libusb_device_descriptor desc;
-                if (libusb_get_device_descriptor(devs[i], &desc) == 0 && desc.idVendor == vid && desc.idProduct == pid) {  // If the device descriptor is retrieved, and both VID and PID correspond to the respective given values
-                    libusb_device_handle *handle;
-                    if (libusb_open(devs[i], &handle) == 0) {  // Open the listed device. If successfull
-                        unsigned char str_desc[256];
-                        libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, str_desc, static_cast<int>(sizeof(str_desc)));  // Get the serial number string in ASCII format
-                        devices.push_back(reinterpret_cast<char *>(str_desc));  // Add the serial number string to the list
-                        libusb_close(handle);  // Close the device
-                    }
-                }
-            }
-            libusb_free_device_list(devs, 1);  // Free device list
-        }
-        libusb_exit(context);  // Deinitialize libusb
+        devices = listDevices(context, vid, pid, errcnt, errstr);
     }
     return devices;
 }
+
+// Helper function to list devices, using the device list and the serial index cached by the given context
+std::list<std::string> CP2130::listDevices(const USBContext &context, uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr)
+{
+    return context.getSerials(vid, pid, errcnt, errstr);  // The serial index of the context is used, so that devices are only opened the first time they are listed
+}
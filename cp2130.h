@@ -1,5 +1,5 @@
-/* CP2130 class - Version 1.2.6
-   Copyright (c) 2021-2024 Samuel Lourenço
+/* CP2130 class - Version 1.3.0
+   Copyright (c) 2021-2026 Samuel Lourenço
 
    This library is free software: you can redistribute it and/or modify it
    under the terms of the GNU Lesser General Public License as published by
@@ -22,22 +22,89 @@
 #define CP2130_H
 
 // Includes
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <list>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <libusb-1.0/libusb.h>
+#include "cp2130transport.h"
+#include "usbcontext.h"
 
 class CP2130
 {
 private:
-    libusb_context *context_;
-    libusb_device_handle *handle_;
-    bool disconnected_, kernelWasAttached_;
+    struct AsyncTransfer;
+    struct StatsEntry;
+
+    // Event kept by the trace ring
+    struct TraceEvent {
+        const char *category;                         // Category (a string literal)
+        const char *name;                             // Name (a string literal), or a null pointer in the case of transfers, whose names are derived from the category and key
+        uint8_t key;                                  // Request or endpoint address (only applicable to transfers)
+        int length;                                   // Requested length (only applicable to transfers)
+        int result;                                   // Number of bytes transferred or libusb error code, or libusb_transfer_status value in the case of asynchronous transfers (only applicable to transfers)
+        std::thread::id thread;                       // Thread that recorded the event
+        std::chrono::steady_clock::time_point begin;  // Time at which the event began
+        std::chrono::steady_clock::time_point end;    // Time at which the event ended
+    };
 
+    USBContext context_;
+    libusb_device_handle *handle_;
+    CP2130Transport *transport_;
+    bool sharedContext_, disconnected_, deviceLost_, kernelWasAttached_, streaming_, streamStopped_, trfprioCached_, gpioShadowEnabled_, failFast_, autoReconnect_, reconnecting_, inEventContext_;
+    uint8_t trfprio_;
+    uint16_t gpioShadow_;
+    size_t asyncQueueDepth_;
+    int asyncErrcnt_;
+    std::string asyncErrstr_;
+    std::list<libusb_transfer *> asyncTransfers_;
+    std::list<libusb_transfer *> asyncIdleTransfers_;  // Transfers that were reaped, kept along with their state so that they can be reused without further allocations
+    std::atomic<bool> rtrStopRequested_;  // Set by stopRTR() while streaming, so that readStream() stops the stream and aborts the ReadWithRTR command once the event loop returns
+    std::mutex streamMutex_;              // Guards the transitions of streaming_, so that a stop request made from another thread is never lost
+    bool errorRingEnabled_;
+    size_t errorsRecorded_;
+
+    // Reconnection state (see also the trailing private section)
+    uint8_t bus_;                 // Bus number of the open device, used by reconnect()
+    std::vector<uint8_t> ports_;  // Port path of the open device, used by reconnect()
+    std::string serial_;          // Serial number of the open device, used by reconnect() to verify that the same device is found at the same location
+    uint8_t gpioModes_[11];       // Last modes applied to each GPIO pin via configureGPIO(), restored by reconnect()
+    uint16_t spiModesSet_;        // Bitmap of the channels whose SPI mode was applied
+    uint16_t spiDelaysSet_;       // Bitmap of the channels whose SPI delays were applied
+    uint16_t gpioModesSet_;       // Bitmap of the pins whose mode was applied
+    uint16_t csSet_;              // Bitmap of the channels whose chip select was enabled or disabled
+    uint16_t csEnabled_;          // Bitmap of the channels whose chip select was last enabled
+    uint16_t gpioValuesSet_;      // Bitmap of the pins whose value was written (see BMGPIO0 to BMGPIO10)
+    uint16_t gpioValues_;         // Last values written to those pins
+
+    // Tracing state
+    std::atomic<bool> tracingEnabled_;                  // Read by every transfer, possibly from several threads, without locking the trace mutex
+    std::chrono::steady_clock::time_point traceEpoch_;  // Time corresponding to the zero timestamp of the trace
+    std::vector<TraceEvent> traceRing_;
+    size_t traceRecorded_;
+    mutable std::mutex traceMutex_;                     // Guards the trace ring, which may be written by several threads (e.g., the sampler thread of ITUSB1Device)
+
+    unsigned int bulkTimeout(uint8_t endpointAddr) const;
+    bool claimInterface(libusb_device_handle *handle);
+    void recordTrace(const char *category, const char *name, uint8_t key, int length, int result, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+    void recordTransfer(StatsEntry &entry, int bytes, int result, bool failed, std::chrono::steady_clock::time_point start);
+    void rememberLocation();
+    void reportError(uint8_t type, uint8_t endpointAddr, uint8_t bmRequestType, uint8_t bRequest, int status, int &errcnt, std::string &errstr);
+    int handleEventsTimeout(timeval *timeout);
     std::u16string getDescGeneric(uint8_t command, int &errcnt, std::string &errstr);
+    size_t readStream(uint8_t command, uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, unsigned int timeout, const std::function<bool(const uint8_t *, size_t)> &sink, int &errcnt, std::string &errstr);
+    void restoreState(int &errcnt, std::string &errstr);
+    void submitAsyncTransfer(uint8_t endpointAddr, unsigned char *data, int length, unsigned int timeout, const std::function<void(int, unsigned char *, int)> &callback, bool copyCallback, int &errcnt, std::string &errstr);
     void writeDescGeneric(const std::u16string &descriptor, uint8_t command, int &errcnt, std::string &errstr);
 
+    static void LIBUSB_CALL asyncTransferCallback(libusb_transfer *transfer);
+    static std::string serialNumber(libusb_device_handle *handle);
+
 public:
     // Class definitions
     static const uint16_t VID = 0x10c4;    // Default USB vendor ID
@@ -92,6 +159,11 @@ public:
     static const uint8_t WRITEREAD = 0x02;    // WriteRead command
     static const uint8_t READWITHRTR = 0x04;  // ReadWithRTR command
 
+    // The following values are applicable to bulkTransferAsync()/spiReadAsync()/spiReadWithRTR()/spiWriteRead()
+    static const size_t ASYNC_CHUNK_SIZE = 512;     // Size of each IN transfer submitted by spiReadAsync() (must be a multiple of the 64-byte packet size)
+    static const size_t ASYNC_QUEUE_DEPTH = 4;      // Default number of IN transfers (or WriteRead commands, in the case of spiWriteRead()) kept in flight
+    static const size_t ASYNC_QUEUE_MAXDEPTH = 32;  // Maximum number of IN transfers (or WriteRead commands, in the case of spiWriteRead()) kept in flight
+
     // The following values are applicable to controlTransfer()
     static const uint8_t GET = 0xc0;                                 // Device-to-Host vendor request
     static const uint8_t SET = 0x40;                                 // Host-to-Device vendor request
@@ -242,6 +314,32 @@ public:
     static const uint8_t PRIOREAD = 0x00;     // Value corresponding to data transfer with high priority read
     static const uint8_t PRIOWRITE = 0x01;    // Value corresponding to data transfer with high priority write
 
+    // The following values are applicable to ErrorRecord/errorRecords()
+    static const uint8_t ETCONTROL = 0x00;       // Failed control transfer
+    static const uint8_t ETBULK = 0x01;          // Failed bulk transfer
+    static const uint8_t ETASYNCSUBMIT = 0x02;   // Failed submission of an asynchronous bulk transfer
+    static const uint8_t ETASYNC = 0x03;         // Failed asynchronous bulk transfer
+    static const uint8_t ETSKIPCONTROL = 0x04;   // Control transfer not issued, since the device is disconnected (see enableFailFast())
+    static const uint8_t ETSKIPBULK = 0x05;      // Bulk transfer not issued, since the device is disconnected (see enableFailFast())
+    static const size_t ERROR_RING_SIZE = 64;    // Number of error records kept by the error ring (older records are overwritten)
+
+    // The following values are applicable to enableTracing()
+    static const size_t TRACE_BUFFER_SIZE = 16384;  // Default number of events kept by the trace ring (older events are overwritten)
+
+    // The following values are applicable to TransferStats/transferStats()
+    static const size_t STATS_BUCKETS = 24;  // Number of buckets of each latency histogram (bucket 0 counts transfers that took less than 1us, bucket n counts those that took from 2^(n-1) to 2^n - 1us, and the last bucket also counts any slower transfers)
+
+    struct ErrorRecord {
+        uint8_t type;           // Type of the failed transfer (see the values applicable to ErrorRecord)
+        uint8_t endpointAddr;   // Endpoint address (only applicable to bulk transfers)
+        uint8_t bmRequestType;  // Request type (only applicable to control transfers)
+        uint8_t bRequest;       // Request (only applicable to control transfers)
+        int status;             // libusb error code, or libusb_transfer_status value in the case of ETASYNC (zero if fewer bytes than expected were transferred)
+
+        bool operator ==(const ErrorRecord &other) const;
+        bool operator !=(const ErrorRecord &other) const;
+    };
+
     struct EventCounter {
         bool overflow;   // Overflow flag
         uint8_t mode;    // GPIO.4/EVTCNTR pin mode (see the values applicable to PinConfig/getPinConfig()/writePinConfig())
@@ -251,6 +349,24 @@ public:
         bool operator !=(const EventCounter &other) const;
     };
 
+    struct GPIOSnapshot {
+        uint16_t values;  // GPIO values bitmap, as returned by getGPIOs() (see BMGPIO0 to BMGPIO10)
+
+        bool gpio0() const;
+        bool gpio1() const;
+        bool gpio2() const;
+        bool gpio3() const;
+        bool gpio4() const;
+        bool gpio5() const;
+        bool gpio6() const;
+        bool gpio7() const;
+        bool gpio8() const;
+        bool gpio9() const;
+        bool gpio10() const;
+        bool operator ==(const GPIOSnapshot &other) const;
+        bool operator !=(const GPIOSnapshot &other) const;
+    };
+
     struct PinConfig {
         uint8_t gpio0;       // GPIO.0 pin config
         uint8_t gpio1;       // GPIO.1 pin config
@@ -313,6 +429,29 @@ public:
         bool operator !=(const SPIMode &other) const;
     };
 
+    struct Timeouts {
+        unsigned int control;  // Timeout for control transfers, in milliseconds
+        unsigned int bulkOut;  // Timeout for bulk OUT transfers, in milliseconds
+        unsigned int bulkIn;   // Timeout for bulk IN transfers, in milliseconds
+
+        bool operator ==(const Timeouts &other) const;
+        bool operator !=(const Timeouts &other) const;
+    };
+
+    struct TransferStats {
+        uint8_t type;                        // Type of the transfers (ETCONTROL or ETBULK)
+        uint8_t key;                         // Request (in the case of control transfers) or endpoint address (in the case of bulk transfers)
+        uint64_t transfers;                  // Number of transfers issued
+        uint64_t bytes;                      // Number of bytes transferred
+        uint64_t errors;                     // Number of failed transfers (timeouts included)
+        uint64_t timeouts;                   // Number of transfers that timed out
+        uint64_t totalTime;                  // Total time taken by the transfers, in microseconds
+        uint64_t histogram[STATS_BUCKETS];   // Latency histogram (see STATS_BUCKETS)
+
+        bool operator ==(const TransferStats &other) const;
+        bool operator !=(const TransferStats &other) const;
+    };
+
     struct USBConfig {
         uint16_t vid;     // Vendor ID (little-endian)
         uint16_t pid;     // Product ID (little-endian)
@@ -326,21 +465,71 @@ public:
         bool operator !=(const USBConfig &other) const;
     };
 
+    struct DeviceInfo {
+        std::string serial;          // Serial number
+        uint8_t bus;                 // Bus number
+        std::vector<uint8_t> ports;  // Port path, from the root hub down to the device
+        uint8_t address;             // Device address
+        USBConfig config;            // USB configuration (as returned by getUSBConfig())
+        SiliconVersion silicon;      // Silicon version (as returned by getSiliconVersion())
+
+        bool operator ==(const DeviceInfo &other) const;
+        bool operator !=(const DeviceInfo &other) const;
+    };
+
+    typedef std::function<void(int status, unsigned char *data, int transferred)> AsyncCallback;  // Completion callback used by bulkTransferAsync() ("status" is a libusb_transfer_status value)
+    typedef std::function<void(const uint8_t *data, size_t length)> ReadCallback;                 // Data callback used by spiReadAsync(), called in order as each chunk arrives
+    typedef std::function<bool(const uint8_t *data, size_t length)> SinkCallback;                 // Data sink used by spiReadWithRTR(), called in order as each chunk arrives (returning false stops the stream)
+
     CP2130();
+    explicit CP2130(const USBContext &context);
     ~CP2130();
 
+    size_t asyncQueueDepth() const;
+    USBContext context() const;
     bool disconnected() const;
+    std::vector<ErrorRecord> errorRecords() const;
+    GPIOSnapshot gpioShadow() const;
+    bool isAutoReconnectEnabled() const;
+    bool isErrorRingEnabled() const;
+    bool isFailFastEnabled() const;
+    bool isGPIOShadowEnabled() const;
     bool isOpen() const;
+    bool isTracingEnabled() const;
+    size_t lostErrorRecords() const;
+    size_t lostTraceEvents() const;
+    size_t pendingTransfers() const;
+    Timeouts timeouts() const;
+    std::string traceJSON() const;
+    std::vector<TransferStats> transferStats() const;
+
+    void addTraceEvent(const char *category, const char *name, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
 
     void bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length, int *transferred, int &errcnt, std::string &errstr);
+    void bulkTransferAsync(uint8_t endpointAddr, unsigned char *data, int length, const AsyncCallback &callback, int &errcnt, std::string &errstr);
+    void cancelAsyncTransfers();
+    void clearErrorRecords();
+    void clearTrace();
+    void clearTransferStats();
     void close();
+    void collectAsyncErrors(int &errcnt, std::string &errstr);
     void configureGPIO(uint8_t pin, uint8_t mode, bool value, int &errcnt, std::string &errstr);
     void configureSPIDelays(uint8_t channel, const SPIDelays &delays, int &errcnt, std::string &errstr);
     void configureSPIMode(uint8_t channel, const SPIMode &mode, int &errcnt, std::string &errstr);
     void controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, int &errcnt, std::string &errstr);
     void disableCS(uint8_t channel, int &errcnt, std::string &errstr);
+    void disableAutoReconnect();
+    void disableErrorRing();
+    void disableFailFast();
+    void disableGPIOShadow();
     void disableSPIDelays(uint8_t channel, int &errcnt, std::string &errstr);
+    void disableTracing();
     void enableCS(uint8_t channel, int &errcnt, std::string &errstr);
+    void enableAutoReconnect();
+    void enableErrorRing();
+    void enableFailFast();
+    void enableGPIOShadow();
+    void enableTracing(size_t capacity = TRACE_BUFFER_SIZE);
     uint8_t getClockDivider(int &errcnt, std::string &errstr);
     bool getCS(uint8_t channel, int &errcnt, std::string &errstr);
     uint8_t getEndpointInAddr(int &errcnt, std::string &errstr);
@@ -359,6 +548,7 @@ public:
     bool getGPIO9(int &errcnt, std::string &errstr);
     bool getGPIO10(int &errcnt, std::string &errstr);
     uint16_t getGPIOs(int &errcnt, std::string &errstr);
+    GPIOSnapshot getGPIOSnapshot(int &errcnt, std::string &errstr);
     uint16_t getLockWord(int &errcnt, std::string &errstr);
     std::u16string getManufacturerDesc(int &errcnt, std::string &errstr);
     PinConfig getPinConfig(int &errcnt, std::string &errstr);
@@ -370,13 +560,17 @@ public:
     SPIMode getSPIMode(uint8_t channel, int &errcnt, std::string &errstr);
     uint8_t getTransferPriority(int &errcnt, std::string &errstr);
     USBConfig getUSBConfig(int &errcnt, std::string &errstr);
+    void handleEvents(int &errcnt, std::string &errstr);
     bool isOTPBlank(int &errcnt, std::string &errstr);
     bool isOTPLocked(int &errcnt, std::string &errstr);
     bool isRTRActive(int &errcnt, std::string &errstr);
     void lockOTP(int &errcnt, std::string &errstr);
     int open(uint16_t vid, uint16_t pid, const std::string &serial = std::string());
+    int open(CP2130Transport &transport);
+    bool reconnect(int &errcnt, std::string &errstr);
     void reset(int &errcnt, std::string &errstr);
     void selectCS(uint8_t channel, int &errcnt, std::string &errstr);
+    void setAsyncQueueDepth(size_t depth, int &errcnt, std::string &errstr);
     void setClockDivider(uint8_t value, int &errcnt, std::string &errstr);
     void setEventCounter(const EventCounter &evcntr, int &errcnt, std::string &errstr);
     void setFIFOThreshold(uint8_t threshold, int &errcnt, std::string &errstr);
@@ -392,8 +586,15 @@ public:
     void setGPIO9(bool value, int &errcnt, std::string &errstr);
     void setGPIO10(bool value, int &errcnt, std::string &errstr);
     void setGPIOs(uint16_t bmValues, uint16_t bmMask, int &errcnt, std::string &errstr);
+    void setTimeouts(const Timeouts &timeouts);
+    size_t spiRead(uint8_t *data, uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr);
+    size_t spiRead(uint8_t *data, uint32_t bytesToRead, int &errcnt, std::string &errstr);
     std::vector<uint8_t> spiRead(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr);
     std::vector<uint8_t> spiRead(uint32_t bytesToRead, int &errcnt, std::string &errstr);
+    size_t spiReadAsync(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, const ReadCallback &callback, int &errcnt, std::string &errstr);
+    size_t spiReadAsync(uint32_t bytesToRead, const ReadCallback &callback, int &errcnt, std::string &errstr);
+    size_t spiReadWithRTR(uint32_t bytesToRead, uint8_t endpointInAddr, uint8_t endpointOutAddr, const SinkCallback &sink, int &errcnt, std::string &errstr);
+    size_t spiReadWithRTR(uint32_t bytesToRead, const SinkCallback &sink, int &errcnt, std::string &errstr);
     void spiWrite(const std::vector<uint8_t> &data, uint8_t endpointOutAddr, int &errcnt, std::string &errstr);
     void spiWrite(const std::vector<uint8_t> &data, int &errcnt, std::string &errstr);
     std::vector<uint8_t> spiWriteRead(const std::vector<uint8_t> &data, uint8_t endpointInAddr, uint8_t endpointOutAddr, int &errcnt, std::string &errstr);
@@ -407,7 +608,29 @@ public:
     void writeSerialDesc(const std::u16string &serial, int &errcnt, std::string &errstr);
     void writeUSBConfig(const USBConfig &config, uint8_t mask, int &errcnt, std::string &errstr);
 
+    static std::vector<DeviceInfo> enumerateDevices(uint16_t vid, uint16_t pid, bool parallel, int &errcnt, std::string &errstr);
+    static std::vector<DeviceInfo> enumerateDevices(const USBContext &context, uint16_t vid, uint16_t pid, bool parallel, int &errcnt, std::string &errstr);
+    static std::string errorMessage(const ErrorRecord &record);
     static std::list<std::string> listDevices(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr);
+    static std::list<std::string> listDevices(const USBContext &context, uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr);
+
+private:
+    // Error ring, timeout, reconnection and statistics state (declared here, since it depends on the above types)
+    // The statistics counters are atomic, so that transferStats() may be called from any thread
+    struct StatsEntry {
+        std::atomic<uint64_t> transfers, bytes, errors, timeouts, totalTime;
+        std::atomic<uint64_t> histogram[STATS_BUCKETS];
+    };
+
+    std::vector<ErrorRecord> errorRing_;
+    Timeouts timeouts_;
+    SPIMode spiModes_[11];                  // Last SPI modes applied to each channel, restored by reconnect()
+    SPIDelays spiDelays_[11];               // Last SPI delays applied to each channel, restored by reconnect()
+    std::vector<StatsEntry> controlStats_;  // Indexed by request
+    std::vector<StatsEntry> bulkStats_;     // Indexed by endpoint number, plus 16 in the case of IN endpoints
+
+    // Enumeration helper (declared here, since it depends on the above types)
+    static void queryDevice(libusb_device_handle *handle, DeviceInfo &info, int &errcnt, std::string &errstr);
 };
 
 #endif  // CP2130_H
@@ -0,0 +1,955 @@
+/* CP2130 simulator class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+
+// Includes
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "cp2130simulator.h"
+
+// Definitions
+const uint16_t GPIO_BITMAPS[11] = {  // GPIO bitmaps indexed by pin number
+    CP2130::BMGPIO0, CP2130::BMGPIO1, CP2130::BMGPIO2, CP2130::BMGPIO3, CP2130::BMGPIO4, CP2130::BMGPIO5,
+    CP2130::BMGPIO6, CP2130::BMGPIO7, CP2130::BMGPIO8, CP2130::BMGPIO9, CP2130::BMGPIO10
+};
+const uint16_t GPIO_IDLE = 0x7df8;         // All GPIO pins high, which is the idle state of the ITUSB1 board (VBUS and data lines off, no overcurrent)
+const uint8_t SILICON_MAJ = 0x01;          // Major read-only version reported by the simulated CP2130
+const uint8_t SILICON_MIN = 0x10;          // Minor read-only version reported by the simulated CP2130
+const uint16_t ADC_MAXCODE = 0x0fff;       // Maximum code of the LTC2312 (12-bit)
+const size_t DESC_TBLSIZE = 64;            // Size of the tables returned by the descriptor requests
+const size_t CMD_SIZE = 8;                 // Size of a bulk command header
+
+// Private function that returns the number of bytes that can be read from the IN endpoint at this moment
+size_t CP2130Simulator::availableIn() const
+{
+    size_t available = inBuffer_.size() - inHead_;
+    if (command_ != CP2130::READWITHRTR || rtrActive_) {  // A ReadWithRTR command only progresses while RTR is active
+        available += readRemaining_;
+    }
+    return available;
+}
+
+// Private function that clocks a byte on the SPI bus, and returns the byte read from MISO
+// Only the LTC2312 on channel 0 drives MISO - Each of its frames shifts out the 12-bit code of the previous conversion, MSB first, followed by four zeros
+uint8_t CP2130Simulator::clockSPI()
+{
+    uint8_t miso = 0x00;
+    if ((0x0001 & csEnabled_) != 0x0000) {  // If the chip select of channel 0 is enabled
+        if ((0x08 & spiDelays_[0][0]) != 0x00) {  // If the chip select is toggled between bytes, each byte is a frame of its own, and only carries the eight most significant bits
+            miso = static_cast<uint8_t>(adcLatched_ >> 4);
+            adcLatched_ = adcCode_;  // A new conversion is triggered by the chip select deassertion
+        } else if (frameBytes_ == 0) {
+            miso = static_cast<uint8_t>(adcLatched_ >> 4);
+        } else if (frameBytes_ == 1) {
+            miso = static_cast<uint8_t>(adcLatched_ << 4);
+        }
+    }
+    ++frameBytes_;
+    return miso;
+}
+
+// Private function that applies jitter to the given completion time, and returns the time at which the transfer is due
+// Completions are never reordered, so a transfer is never due before the previous one, regardless of jitter
+std::chrono::steady_clock::time_point CP2130Simulator::delay(std::chrono::steady_clock::time_point time)
+{
+    std::chrono::steady_clock::time_point due = time + std::chrono::microseconds(jitter());
+    if (due < lastDue_) {
+        due = lastDue_;
+    }
+    lastDue_ = due;
+    return due;
+}
+
+// Private procedure used to end the current SPI frame, which deasserts the chip select and triggers a new LTC2312 conversion
+void CP2130Simulator::endFrame()
+{
+    if (frameBytes_ > 0 && (0x0001 & csEnabled_) != 0x0000 && (0x08 & spiDelays_[0][0]) == 0x00) {
+        adcLatched_ = adcCode_;
+    }
+    frameBytes_ = 0;
+}
+
+// Private function that occupies the simulated bus with a transfer, and returns the time at which the transfer is due, according to the latency model
+// A transfer that finds the bus idle starts at the next frame boundary, while one that finds it busy starts as soon as the previous transfer ends - Bulk transfers take one packet time per packet (a zero-length transfer still takes one packet), and packets that do not fit in the current frame are moved to the next one
+std::chrono::steady_clock::time_point CP2130Simulator::schedule(bool control, int length)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (start < busFree_) {
+        start = busFree_;
+    } else if (latency_.frameInterval != 0) {
+        long long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(start - epoch_).count();
+        long long frame = (elapsed + latency_.frameInterval - 1) / latency_.frameInterval;
+        start = epoch_ + std::chrono::microseconds(frame * latency_.frameInterval);
+    }
+    std::chrono::steady_clock::time_point end = start;
+    if (control) {
+        end += std::chrono::microseconds(latency_.controlOverhead);
+    } else {
+        size_t packets = length > 0 ? (static_cast<size_t>(length) + PACKET_SIZE - 1) / PACKET_SIZE : 1;
+        for (size_t i = 0; i < packets; ++i) {
+            if (latency_.frameInterval != 0 && latency_.framePackets != 0) {
+                long long frame = std::chrono::duration_cast<std::chrono::microseconds>(end - epoch_).count() / latency_.frameInterval;
+                if (frame != frame_) {
+                    frame_ = frame;
+                    framePacketCount_ = 0;
+                }
+                if (framePacketCount_ == latency_.framePackets) {  // If the current frame is full, the packet is sent at the start of the next frame
+                    ++frame_;
+                    framePacketCount_ = 0;
+                    end = epoch_ + std::chrono::microseconds(frame_ * latency_.frameInterval);
+                }
+                ++framePacketCount_;
+            }
+            end += std::chrono::microseconds(latency_.packetTime);
+        }
+    }
+    busFree_ = end;
+    return delay(end);
+}
+
+// Private function that returns the address of the IN endpoint, according to the transfer priority in the OTP ROM
+uint8_t CP2130Simulator::endpointInAddr() const
+{
+    return prom_[CP2130::PROMIDX_TRANSFER_PRIORITY] == CP2130::PRIOWRITE ? 0x82 : 0x81;
+}
+
+// Private function that returns the address of the OUT endpoint, according to the transfer priority in the OTP ROM
+uint8_t CP2130Simulator::endpointOutAddr() const
+{
+    return prom_[CP2130::PROMIDX_TRANSFER_PRIORITY] == CP2130::PRIOWRITE ? 0x01 : 0x02;
+}
+
+// Private procedure that sets the status and the actual length of the given asynchronous transfer, and queues it for completion at the given time
+void CP2130Simulator::finishTransfer(libusb_transfer *transfer, libusb_transfer_status status, int actualLength, std::chrono::steady_clock::time_point due)
+{
+    transfer->status = status;
+    transfer->actual_length = actualLength;
+    Completion completion = {transfer, due};
+    completed_.push_back(completion);
+}
+
+// Private function that handles a Device-to-Host vendor request, and returns the number of bytes transferred, or LIBUSB_ERROR_PIPE if the request is stalled
+int CP2130Simulator::getRequest(uint8_t bRequest, uint16_t wIndex, unsigned char *data, uint16_t wLength)
+{
+    unsigned char reply[DESC_TBLSIZE] = {0x00};
+    size_t length;
+    switch (bRequest) {
+        case CP2130::GET_READONLY_VERSION:
+            reply[0] = SILICON_MAJ;
+            reply[1] = SILICON_MIN;
+            length = CP2130::GET_READONLY_VERSION_WLEN;
+            break;
+        case CP2130::GET_GPIO_VALUES: {
+            uint16_t values = static_cast<uint16_t>((gpioLatch_ & ~inputPins()) | (gpioInputs_ & inputPins()));
+            reply[0] = static_cast<uint8_t>(values >> 8);
+            reply[1] = static_cast<uint8_t>(values);
+            length = CP2130::GET_GPIO_VALUES_WLEN;
+            break;
+        }
+        case CP2130::GET_GPIO_MODE_AND_LEVEL: {
+            uint16_t outputs = 0x0000;
+            for (size_t pin = 0; pin < 11; ++pin) {
+                if (gpioModes_[pin] == CP2130::PCOUTOD || gpioModes_[pin] == CP2130::PCOUTPP) {
+                    outputs = static_cast<uint16_t>(outputs | GPIO_BITMAPS[pin]);
+                }
+            }
+            reply[0] = static_cast<uint8_t>(outputs >> 8);  // Output pins bitmap
+            reply[1] = static_cast<uint8_t>(outputs);
+            reply[2] = static_cast<uint8_t>(gpioLatch_ >> 8);  // Output levels bitmap
+            reply[3] = static_cast<uint8_t>(gpioLatch_);
+            length = CP2130::GET_GPIO_MODE_AND_LEVEL_WLEN;
+            break;
+        }
+        case CP2130::GET_GPIO_CHIP_SELECT: {
+            uint16_t csPins = 0x0000;
+            for (size_t pin = 0; pin < 11; ++pin) {
+                if (gpioModes_[pin] == CP2130::PCCS) {
+                    csPins = static_cast<uint16_t>(csPins | 1 << pin);
+                }
+            }
+            reply[0] = static_cast<uint8_t>(csEnabled_ >> 8);  // Channel chip select enable bitmap
+            reply[1] = static_cast<uint8_t>(csEnabled_);
+            reply[2] = static_cast<uint8_t>(csPins >> 8);  // Pin chip select enable bitmap
+            reply[3] = static_cast<uint8_t>(csPins);
+            length = CP2130::GET_GPIO_CHIP_SELECT_WLEN;
+            break;
+        }
+        case CP2130::GET_SPI_WORD:
+            std::memcpy(reply, spiWords_, sizeof(spiWords_));
+            length = CP2130::GET_SPI_WORD_WLEN;
+            break;
+        case CP2130::GET_SPI_DELAY:
+            if (wIndex > 10) {
+                return LIBUSB_ERROR_PIPE;  // Invalid channel
+            }
+            reply[0] = static_cast<uint8_t>(wIndex);
+            std::memcpy(reply + 1, spiDelays_[wIndex], sizeof(spiDelays_[wIndex]));
+            length = CP2130::GET_SPI_DELAY_WLEN;
+            break;
+        case CP2130::GET_FULL_THRESHOLD:
+            reply[0] = fifoThreshold_;
+            length = CP2130::GET_FULL_THRESHOLD_WLEN;
+            break;
+        case CP2130::GET_RTR_STATE:
+            reply[0] = command_ == CP2130::READWITHRTR && readRemaining_ > 0 ? 0x01 : 0x00;
+            length = CP2130::GET_RTR_STATE_WLEN;
+            break;
+        case CP2130::GET_EVENT_COUNTER:
+            reply[0] = static_cast<uint8_t>(0x07 & eventCounterMode_);
+            reply[1] = static_cast<uint8_t>(eventCount_ >> 8);
+            reply[2] = static_cast<uint8_t>(eventCount_);
+            length = CP2130::GET_EVENT_COUNTER_WLEN;
+            break;
+        case CP2130::GET_CLOCK_DIVIDER:
+            reply[0] = clockDivider_;
+            length = CP2130::GET_CLOCK_DIVIDER_WLEN;
+            break;
+        case CP2130::GET_USB_CONFIG:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_VID, CP2130::GET_USB_CONFIG_WLEN);  // The USB configuration fields are contiguous in the OTP ROM, and in the same order
+            length = CP2130::GET_USB_CONFIG_WLEN;
+            break;
+        case CP2130::GET_MANUFACTURING_STRING_1:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_MANUFACTURING_STRING_1, CP2130::PROMSZE_MANUFACTURING_STRING_1);
+            length = DESC_TBLSIZE;
+            break;
+        case CP2130::GET_MANUFACTURING_STRING_2:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_MANUFACTURING_STRING_2, CP2130::PROMSZE_MANUFACTURING_STRING_2);
+            length = DESC_TBLSIZE;
+            break;
+        case CP2130::GET_PRODUCT_STRING_1:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_PRODUCT_STRING_1, CP2130::PROMSZE_PRODUCT_STRING_1);
+            length = DESC_TBLSIZE;
+            break;
+        case CP2130::GET_PRODUCT_STRING_2:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_PRODUCT_STRING_2, CP2130::PROMSZE_PRODUCT_STRING_2);
+            length = DESC_TBLSIZE;
+            break;
+        case CP2130::GET_SERIAL_STRING:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_SERIAL_STRING, CP2130::PROMSZE_SERIAL_STRING);
+            length = DESC_TBLSIZE;
+            break;
+        case CP2130::GET_PIN_CONFIG:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_PIN_CONFIG, CP2130::PROMSZE_PIN_CONFIG);
+            length = CP2130::GET_PIN_CONFIG_WLEN;
+            break;
+        case CP2130::GET_LOCK_BYTE:
+            std::memcpy(reply, prom_ + CP2130::PROMIDX_LOCK_BYTE, CP2130::PROMSZE_LOCK_BYTE);
+            length = CP2130::GET_LOCK_BYTE_WLEN;
+            break;
+        case CP2130::GET_PROM_CONFIG:
+            if (wIndex >= CP2130::PROM_BLOCKS) {
+                return LIBUSB_ERROR_PIPE;  // Invalid block
+            }
+            std::memcpy(reply, prom_ + CP2130::PROM_BLOCK_SIZE * wIndex, CP2130::PROM_BLOCK_SIZE);
+            length = CP2130::GET_PROM_CONFIG_WLEN;
+            break;
+        default:
+            return LIBUSB_ERROR_PIPE;  // Unsupported request
+    }
+    if (wLength < length) {  // As with a physical device, the data stage is truncated to the requested length
+        length = wLength;
+    }
+    std::memcpy(data, reply, length);
+    return static_cast<int>(length);
+}
+
+// Private function that returns the bitmap of the GPIO pins that are currently configured as inputs
+uint16_t CP2130Simulator::inputPins() const
+{
+    uint16_t inputs = 0x0000;
+    for (size_t pin = 0; pin < 11; ++pin) {
+        if (gpioModes_[pin] == CP2130::PCIN || (pin == 3 && (gpioModes_[pin] == CP2130::PCNRTR || gpioModes_[pin] == CP2130::PCRTR)) || (pin == 4 && gpioModes_[pin] >= CP2130::PCEVTCNTRRE)) {
+            inputs = static_cast<uint16_t>(inputs | GPIO_BITMAPS[pin]);
+        }
+    }
+    return inputs;
+}
+
+// Private function that returns a random jitter amount in microseconds, according to the latency model
+unsigned int CP2130Simulator::jitter()
+{
+    unsigned int amount = 0;
+    if (latency_.jitterAmount != 0) {
+        if (latency_.jitter == JTUNIFORM) {
+            amount = std::uniform_int_distribution<unsigned int>(0, latency_.jitterAmount)(random_);
+        } else if (latency_.jitter == JTEXPONENTIAL) {
+            amount = static_cast<unsigned int>(std::lround(std::exponential_distribution<double>(1.0 / latency_.jitterAmount)(random_)));
+        }
+    }
+    return amount;
+}
+
+// Private function that returns the lock word from the OTP ROM
+uint16_t CP2130Simulator::lockWord() const
+{
+    return static_cast<uint16_t>(prom_[CP2130::PROMIDX_LOCK_BYTE + 1] << 8 | prom_[CP2130::PROMIDX_LOCK_BYTE]);
+}
+
+// Private procedure used to wake up handleEvents(), after a change that may allow an asynchronous transfer to progress (the mutex must be locked by the caller)
+void CP2130Simulator::notifyChange()
+{
+    ++changeCount_;
+    stateChanged_.notify_all();
+}
+
+// Private function that reads up to the given number of bytes from the IN endpoint, and returns the number of bytes read
+// Data read back by WriteRead commands comes first, followed by any bytes clocked in by a pending Read or ReadWithRTR command
+int CP2130Simulator::readIn(unsigned char *data, int length)
+{
+    size_t nread = availableIn();
+    if (nread > static_cast<size_t>(length)) {
+        nread = static_cast<size_t>(length);
+    }
+    for (size_t i = 0; i < nread; ++i) {
+        if (inHead_ < inBuffer_.size()) {
+            data[i] = inBuffer_[inHead_++];
+        } else {
+            data[i] = clockSPI();
+            if (--readRemaining_ == 0) {
+                endFrame();
+            }
+        }
+    }
+    if (inHead_ == inBuffer_.size()) {
+        inBuffer_.clear();  // The capacity is kept, so that no further allocations are needed
+        inHead_ = 0;
+    }
+    return static_cast<int>(nread);
+}
+
+// Private procedure used to put the simulated CP2130 in its power-on state, according to the OTP ROM
+void CP2130Simulator::resetState()
+{
+    for (size_t pin = 0; pin < 11; ++pin) {
+        gpioModes_[pin] = prom_[CP2130::PROMIDX_PIN_CONFIG + pin];
+        spiWords_[pin] = 0x00;
+        std::memset(spiDelays_[pin], 0x00, sizeof(spiDelays_[pin]));
+    }
+    gpioLatch_ = GPIO_IDLE;
+    csEnabled_ = 0x0000;
+    fifoThreshold_ = 0x08;
+    clockDivider_ = prom_[CP2130::PROMIDX_PIN_CONFIG + 19];
+    eventCounterMode_ = static_cast<uint8_t>(0x07 & gpioModes_[4]);
+    eventCount_ = 0x0000;
+    command_ = CP2130::READ;
+    writeRemaining_ = 0;
+    readRemaining_ = 0;
+    inBuffer_.clear();
+    inHead_ = 0;
+    frameBytes_ = 0;
+}
+
+// Private function that handles a Host-to-Device vendor request, and returns the number of bytes transferred, or LIBUSB_ERROR_PIPE if the request is stalled
+// Writes to the OTP ROM require the PROM write key, and are stalled if the respective fields are locked
+int CP2130Simulator::setRequest(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const unsigned char *data, uint16_t wLength)
+{
+    uint16_t lock = lockWord();
+    bool key = wValue == CP2130::PROM_WRITE_KEY;
+    switch (bRequest) {
+        case CP2130::RESET_DEVICE:
+            if (wLength != CP2130::RESET_DEVICE_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            resetState();
+            break;
+        case CP2130::SET_GPIO_VALUES: {
+            if (wLength != CP2130::SET_GPIO_VALUES_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            uint16_t values = static_cast<uint16_t>(data[0] << 8 | data[1]);
+            uint16_t mask = static_cast<uint16_t>(CP2130::BMGPIOS & (data[2] << 8 | data[3]));
+            gpioLatch_ = static_cast<uint16_t>((gpioLatch_ & ~mask) | (values & mask));
+            break;
+        }
+        case CP2130::SET_GPIO_MODE_AND_LEVEL:
+            if (wLength != CP2130::SET_GPIO_MODE_AND_LEVEL_WLEN || data[0] > 10) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            gpioModes_[data[0]] = data[1];
+            gpioLatch_ = static_cast<uint16_t>(data[2] != 0x00 ? gpioLatch_ | GPIO_BITMAPS[data[0]] : gpioLatch_ & ~GPIO_BITMAPS[data[0]]);
+            break;
+        case CP2130::SET_GPIO_CHIP_SELECT:
+            if (wLength != CP2130::SET_GPIO_CHIP_SELECT_WLEN || data[0] > 10 || data[1] > 0x02) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            if (data[1] == 0x00) {
+                csEnabled_ = static_cast<uint16_t>(csEnabled_ & ~(1 << data[0]));
+            } else if (data[1] == 0x01) {
+                csEnabled_ = static_cast<uint16_t>(csEnabled_ | 1 << data[0]);
+            } else {
+                csEnabled_ = static_cast<uint16_t>(1 << data[0]);
+            }
+            break;
+        case CP2130::SET_SPI_WORD:
+            if (wLength != CP2130::SET_SPI_WORD_WLEN || data[0] > 10) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            spiWords_[data[0]] = data[1];
+            break;
+        case CP2130::SET_SPI_DELAY:
+            if (wLength != CP2130::SET_SPI_DELAY_WLEN || data[0] > 10) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            std::memcpy(spiDelays_[data[0]], data + 1, sizeof(spiDelays_[data[0]]));
+            break;
+        case CP2130::SET_FULL_THRESHOLD:
+            if (wLength != CP2130::SET_FULL_THRESHOLD_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            fifoThreshold_ = data[0];
+            break;
+        case CP2130::SET_RTR_STOP:
+            if (wLength != CP2130::SET_RTR_STOP_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            if (data[0] == 0x01 && command_ == CP2130::READWITHRTR && readRemaining_ > 0) {  // Abort the current ReadWithRTR command
+                readRemaining_ = 0;
+                endFrame();
+            }
+            break;
+        case CP2130::SET_EVENT_COUNTER:
+            if (wLength != CP2130::SET_EVENT_COUNTER_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            eventCounterMode_ = static_cast<uint8_t>(0x07 & data[0]);
+            eventCount_ = static_cast<uint16_t>(data[1] << 8 | data[2]);
+            break;
+        case CP2130::SET_CLOCK_DIVIDER:
+            if (wLength != CP2130::SET_CLOCK_DIVIDER_WLEN) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            clockDivider_ = data[0];
+            break;
+        case CP2130::SET_USB_CONFIG: {
+            uint8_t mask = wLength == CP2130::SET_USB_CONFIG_WLEN ? data[9] : 0x00;
+            if (wLength != CP2130::SET_USB_CONFIG_WLEN || !key || (mask & ~lock & CP2130::LWUSBCFG) != 0x0000) {  // Stall if any of the fields to be written is locked
+                return LIBUSB_ERROR_PIPE;
+            }
+            if ((CP2130::LWVID & mask) != 0x00) {
+                std::memcpy(prom_ + CP2130::PROMIDX_VID, data, CP2130::PROMSZE_VID);
+            }
+            if ((CP2130::LWPID & mask) != 0x00) {
+                std::memcpy(prom_ + CP2130::PROMIDX_PID, data + 2, CP2130::PROMSZE_PID);
+            }
+            if ((CP2130::LWMAXPOW & mask) != 0x00) {
+                prom_[CP2130::PROMIDX_MAX_POWER] = data[4];
+            }
+            if ((CP2130::LWPOWMODE & mask) != 0x00) {
+                prom_[CP2130::PROMIDX_POWER_MODE] = data[5];
+            }
+            if ((CP2130::LWREL & mask) != 0x00) {
+                std::memcpy(prom_ + CP2130::PROMIDX_RELEASE_VERSION, data + 6, CP2130::PROMSZE_RELEASE_VERSION);
+            }
+            if ((CP2130::LWTRFPRIO & mask) != 0x00) {
+                prom_[CP2130::PROMIDX_TRANSFER_PRIORITY] = data[8];
+            }
+            break;
+        }
+        case CP2130::SET_MANUFACTURING_STRING_1:
+        case CP2130::SET_MANUFACTURING_STRING_2:
+        case CP2130::SET_PRODUCT_STRING_1:
+        case CP2130::SET_PRODUCT_STRING_2:
+        case CP2130::SET_SERIAL_STRING: {
+            size_t index, size;
+            uint16_t lockBit;
+            if (bRequest == CP2130::SET_MANUFACTURING_STRING_1) {
+                index = CP2130::PROMIDX_MANUFACTURING_STRING_1;
+                size = CP2130::PROMSZE_MANUFACTURING_STRING_1;
+                lockBit = 0x0020;
+            } else if (bRequest == CP2130::SET_MANUFACTURING_STRING_2) {
+                index = CP2130::PROMIDX_MANUFACTURING_STRING_2;
+                size = CP2130::PROMSZE_MANUFACTURING_STRING_2;
+                lockBit = 0x0040;
+            } else if (bRequest == CP2130::SET_PRODUCT_STRING_1) {
+                index = CP2130::PROMIDX_PRODUCT_STRING_1;
+                size = CP2130::PROMSZE_PRODUCT_STRING_1;
+                lockBit = 0x0100;
+            } else if (bRequest == CP2130::SET_PRODUCT_STRING_2) {
+                index = CP2130::PROMIDX_PRODUCT_STRING_2;
+                size = CP2130::PROMSZE_PRODUCT_STRING_2;
+                lockBit = 0x0200;
+            } else {
+                index = CP2130::PROMIDX_SERIAL_STRING;
+                size = CP2130::PROMSZE_SERIAL_STRING;
+                lockBit = CP2130::LWSER;
+            }
+            if (wLength != DESC_TBLSIZE || !key || (lockBit & lock) == 0x0000) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            std::memcpy(prom_ + index, data, size);
+            break;
+        }
+        case CP2130::SET_PIN_CONFIG:
+            if (wLength != CP2130::SET_PIN_CONFIG_WLEN || !key || (CP2130::LWPINCFG & lock) == 0x0000) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            std::memcpy(prom_ + CP2130::PROMIDX_PIN_CONFIG, data, CP2130::PROMSZE_PIN_CONFIG);
+            break;
+        case CP2130::SET_LOCK_BYTE:
+            if (wLength != CP2130::SET_LOCK_BYTE_WLEN || !key) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            prom_[CP2130::PROMIDX_LOCK_BYTE] &= data[0];  // As with any OTP ROM, bits can only be cleared, and never set again
+            prom_[CP2130::PROMIDX_LOCK_BYTE + 1] &= data[1];
+            break;
+        case CP2130::SET_PROM_CONFIG:
+            if (wLength != CP2130::SET_PROM_CONFIG_WLEN || !key || wIndex >= CP2130::PROM_BLOCKS || (CP2130::LWALL & lock) != CP2130::LWALL) {  // The OTP ROM can only be rewritten as a whole if no fields are locked
+                return LIBUSB_ERROR_PIPE;
+            }
+            std::memcpy(prom_ + CP2130::PROM_BLOCK_SIZE * wIndex, data, CP2130::PROM_BLOCK_SIZE);
+            break;
+        default:
+            return LIBUSB_ERROR_PIPE;  // Unsupported request
+    }
+    return wLength;
+}
+
+// Private function that processes the data written to the OUT endpoint, and returns zero if successful, or LIBUSB_ERROR_PIPE if an invalid command is received
+// Each command consists of an eight-byte header, followed by the payload in the case of Write and WriteRead commands, which may span several transfers
+int CP2130Simulator::writeOut(const unsigned char *data, int length)
+{
+    size_t size = static_cast<size_t>(length);
+    size_t i = 0;
+    while (i < size) {
+        if (writeRemaining_ > 0) {  // Payload of the current Write or WriteRead command
+            size_t nwrite = size - i < writeRemaining_ ? size - i : writeRemaining_;
+            for (size_t j = 0; j < nwrite; ++j) {
+                uint8_t miso = clockSPI();  // The LTC2312 ignores MOSI, so the written data is simply discarded
+                if (command_ == CP2130::WRITEREAD) {
+                    inBuffer_.push_back(miso);
+                }
+            }
+            writeRemaining_ -= static_cast<uint32_t>(nwrite);
+            i += nwrite;
+            if (writeRemaining_ == 0) {
+                endFrame();
+            }
+        } else if (size - i < CMD_SIZE) {  // Incomplete command header
+            return LIBUSB_ERROR_PIPE;
+        } else {
+            uint8_t command = data[i + 2];
+            uint32_t count = static_cast<uint32_t>(data[i + 7] << 24 | data[i + 6] << 16 | data[i + 5] << 8 | data[i + 4]);
+            i += CMD_SIZE;
+            if (command != CP2130::READ && command != CP2130::WRITE && command != CP2130::WRITEREAD && command != CP2130::READWITHRTR) {
+                return LIBUSB_ERROR_PIPE;
+            }
+            if (readRemaining_ > 0) {  // A new command aborts any read that was still pending
+                readRemaining_ = 0;
+                endFrame();
+            }
+            command_ = command;
+            if (command == CP2130::READ || command == CP2130::READWITHRTR) {
+                readRemaining_ = count;
+            } else {
+                writeRemaining_ = count;
+            }
+        }
+    }
+    return 0;
+}
+
+// Private procedure used to write the given descriptor to the OTP ROM, as a USB string descriptor laid across one or two fields
+void CP2130Simulator::writeDescriptor(size_t index, size_t size, size_t nextIndex, size_t nextSize, const std::u16string &descriptor)
+{
+    size_t length = 2 * descriptor.size() + 2;
+    for (size_t i = 0; i < size + nextSize; ++i) {
+        uint8_t value;
+        if (i == 0) {
+            value = static_cast<uint8_t>(length);  // USB string descriptor length
+        } else if (i == 1) {
+            value = 0x03;  // USB string descriptor constant
+        } else if (i < length) {
+            value = static_cast<uint8_t>(descriptor[(i - 2) / 2] >> (i % 2 == 0 ? 0 : 8));  // UTF-16LE
+        } else {
+            value = 0x00;
+        }
+        prom_[i < size ? index + i : nextIndex + i - size] = value;
+    }
+}
+
+// "Equal to" operator for LatencyModel
+bool CP2130Simulator::LatencyModel::operator ==(const CP2130Simulator::LatencyModel &other) const
+{
+    return frameInterval == other.frameInterval && controlOverhead == other.controlOverhead && packetTime == other.packetTime && framePackets == other.framePackets && jitter == other.jitter && jitterAmount == other.jitterAmount;
+}
+
+// "Not equal to" operator for LatencyModel
+bool CP2130Simulator::LatencyModel::operator !=(const CP2130Simulator::LatencyModel &other) const
+{
+    return !(operator ==(other));
+}
+
+// Built-in latency models
+const CP2130Simulator::LatencyModel CP2130Simulator::LATENCY_NONE = {
+    0,       // No frame scheduling
+    0,       // Control transfers complete instantly
+    0,       // Bulk packets take no time
+    0,       // No limit on the number of bulk packets per frame
+    JTNONE,  // No jitter
+    0
+};
+const CP2130Simulator::LatencyModel CP2130Simulator::LATENCY_FULL_SPEED = {
+    1000,       // Full-speed frames are 1ms long
+    250,        // A vendor request (setup, data and status stages) takes a fraction of a frame, once scheduled
+    50,         // A 64-byte packet takes about 43us at 12Mbps, plus protocol overhead
+    19,         // Up to 19 bulk packets fit in a full-speed frame
+    JTUNIFORM,  // Host controller and scheduling latencies
+    100         // Up to 100us of jitter
+};
+
+// Constructs a simulated CP2130 having the given VID, PID and serial number, and an otherwise blank OTP ROM (the lock word included)
+// The USB and pin configurations match the ITUSB1 board: GPIO.0 is the chip select of the LTC2312, GPIO.3 is the !UDOC input, and all other pins are push-pull outputs
+CP2130Simulator::CP2130Simulator(uint16_t vid, uint16_t pid, const std::u16string &serial) :
+    stateChanged_(),
+    changeCount_(0),
+    connected_(true),
+    prom_(),
+    gpioModes_(),
+    gpioLatch_(GPIO_IDLE),
+    gpioInputs_(GPIO_IDLE),
+    csEnabled_(0x0000),
+    spiWords_(),
+    spiDelays_(),
+    fifoThreshold_(0x00),
+    clockDivider_(0x00),
+    eventCounterMode_(0x00),
+    eventCount_(0x0000),
+    command_(CP2130::READ),
+    writeRemaining_(0),
+    readRemaining_(0),
+    rtrActive_(true),
+    inBuffer_(),
+    inHead_(0),
+    adcCode_(0x0000),
+    adcLatched_(0x0000),
+    frameBytes_(0),
+    pendingOut_(),
+    pendingIn_(),
+    random_(),
+    epoch_(std::chrono::steady_clock::now()),
+    busFree_(epoch_),
+    lastDue_(epoch_),
+    frame_(-1),
+    framePacketCount_(0),
+    completed_(),
+    latency_(LATENCY_NONE)
+{
+    std::memset(prom_, 0xff, sizeof(prom_));  // Blank OTP ROM
+    prom_[CP2130::PROMIDX_VID] = static_cast<uint8_t>(vid);
+    prom_[CP2130::PROMIDX_VID + 1] = static_cast<uint8_t>(vid >> 8);
+    prom_[CP2130::PROMIDX_PID] = static_cast<uint8_t>(pid);
+    prom_[CP2130::PROMIDX_PID + 1] = static_cast<uint8_t>(pid >> 8);
+    prom_[CP2130::PROMIDX_MAX_POWER] = 0x32;  // 100mA
+    prom_[CP2130::PROMIDX_POWER_MODE] = CP2130::PMBUSREGEN;
+    prom_[CP2130::PROMIDX_RELEASE_VERSION] = 0x02;  // Release version 2.0, which corresponds to hardware revision A of the ITUSB1 board
+    prom_[CP2130::PROMIDX_RELEASE_VERSION + 1] = 0x00;
+    prom_[CP2130::PROMIDX_TRANSFER_PRIORITY] = CP2130::PRIOWRITE;  // As on the ITUSB1 board, whose endpoint addresses are fixed
+    writeDescriptor(CP2130::PROMIDX_MANUFACTURING_STRING_1, CP2130::PROMSZE_MANUFACTURING_STRING_1, CP2130::PROMIDX_MANUFACTURING_STRING_2, CP2130::PROMSZE_MANUFACTURING_STRING_2, u"Bloguetronica");
+    writeDescriptor(CP2130::PROMIDX_PRODUCT_STRING_1, CP2130::PROMSZE_PRODUCT_STRING_1, CP2130::PROMIDX_PRODUCT_STRING_2, CP2130::PROMSZE_PRODUCT_STRING_2, u"CP2130 Simulator");
+    writeDescriptor(CP2130::PROMIDX_SERIAL_STRING, CP2130::PROMSZE_SERIAL_STRING, 0, 0, serial.substr(0, CP2130::DESCMXL_SERIAL));
+    for (size_t pin = 0; pin < 11; ++pin) {
+        prom_[CP2130::PROMIDX_PIN_CONFIG + pin] = pin == 0 ? CP2130::PCCS : (pin == 3 ? CP2130::PCIN : CP2130::PCOUTPP);
+    }
+    std::memset(prom_ + CP2130::PROMIDX_PIN_CONFIG + 11, 0x00, CP2130::PROMSZE_PIN_CONFIG - 11);  // No suspend levels, modes or wakeup matching, and clock divider set to 0
+    resetState();
+}
+
+// Returns the values that the GPIO pins are driving, as last written via the vendor requests (see BMGPIO0 to BMGPIO10)
+uint16_t CP2130Simulator::gpioOutputs() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return gpioLatch_;
+}
+
+// Returns true if the simulated device is connected
+bool CP2130Simulator::isConnected() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connected_;
+}
+
+// Returns the latency model in use
+CP2130Simulator::LatencyModel CP2130Simulator::latencyModel() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return latency_;
+}
+
+// Returns the entire OTP ROM image
+CP2130::PROMConfig CP2130Simulator::promConfig() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    CP2130::PROMConfig config;
+    for (size_t i = 0; i < CP2130::PROM_SIZE; ++i) {
+        config[i] = prom_[i];
+    }
+    return config;
+}
+
+// Performs a synchronous bulk transfer, which returns once it completes according to the latency model (see CP2130Transport)
+// An IN transfer for which no data is available times out after the given timeout, or immediately if the latency model is LATENCY_NONE or no timeout is given
+int CP2130Simulator::bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length, int *transferred, unsigned int timeout)
+{
+    int result;
+    int ntransferred = 0;
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            result = LIBUSB_ERROR_NO_DEVICE;
+            due = std::chrono::steady_clock::now();
+        } else if (endpointAddr == endpointOutAddr()) {
+            result = writeOut(data, length);
+            ntransferred = result == 0 ? length : 0;
+            due = schedule(false, ntransferred);
+        } else if (endpointAddr == endpointInAddr()) {
+            ntransferred = readIn(data, length);
+            if (ntransferred == 0 && length > 0) {
+                result = LIBUSB_ERROR_TIMEOUT;
+                due = latency_ == LATENCY_NONE || timeout == 0 ? std::chrono::steady_clock::now() : delay(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout));
+            } else {
+                result = 0;
+                due = schedule(false, ntransferred);
+            }
+        } else {
+            result = LIBUSB_ERROR_PIPE;  // Nonexistent endpoint
+            due = std::chrono::steady_clock::now();
+        }
+        notifyChange();  // A command written here may produce data for a pending IN transfer
+    }
+    std::this_thread::sleep_until(due);  // The lock is not held while waiting, so that other threads may use the simulated device
+    if (transferred != nullptr) {
+        *transferred = ntransferred;
+    }
+    return result;
+}
+
+// Cancels the given asynchronous transfer, whose callback is then called from within handleEvents() (see CP2130Transport)
+int CP2130Simulator::cancelTransfer(libusb_transfer *transfer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int result = LIBUSB_ERROR_NOT_FOUND;  // Already completed or cancelled
+    std::deque<libusb_transfer *> *queues[2] = {&pendingOut_, &pendingIn_};
+    for (size_t i = 0; i < 2 && result != 0; ++i) {
+        for (std::deque<libusb_transfer *>::iterator it = queues[i]->begin(); it != queues[i]->end(); ++it) {
+            if (*it == transfer) {
+                queues[i]->erase(it);
+                finishTransfer(transfer, LIBUSB_TRANSFER_CANCELLED, 0, delay(std::chrono::steady_clock::now()));
+                notifyChange();
+                result = 0;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+// Performs a control transfer, which returns once it completes according to the latency model (see CP2130Transport)
+int CP2130Simulator::controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int)
+{
+    int result;
+    std::chrono::steady_clock::time_point due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!connected_) {
+            result = LIBUSB_ERROR_NO_DEVICE;
+            due = std::chrono::steady_clock::now();
+        } else {
+            if (bmRequestType == CP2130::GET) {
+                result = getRequest(bRequest, wIndex, data, wLength);
+            } else if (bmRequestType == CP2130::SET) {
+                result = setRequest(bRequest, wValue, wIndex, data, wLength);
+            } else {
+                result = LIBUSB_ERROR_PIPE;  // Only vendor requests are supported
+            }
+            due = schedule(true, 0);  // A stalled request still goes through the setup stage
+        }
+        notifyChange();  // A request such as SET_RTR_STOP may affect a pending IN transfer
+    }
+    std::this_thread::sleep_until(due);
+    return result;
+}
+
+// Progresses the asynchronous transfers, waits for the next transfer to complete according to the latency model (up to the given timeout), and calls the callbacks of those that completed (see CP2130Transport)
+// OUT transfers always progress, while IN transfers progress as soon as data is available - If no transfer can progress, the oldest IN transfer times out after its own timeout, or immediately if the latency model is LATENCY_NONE (IN transfers submitted without a timeout never time out)
+// If no transfer is due to complete, the whole timeout is waited for, unless a transfer is submitted or cancelled, or the simulated device changes state, in the meantime
+int CP2130Simulator::handleEvents(timeval *timeout)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point wakeup = now;
+    unsigned long changes;
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            while (!pendingOut_.empty()) {  // OUT transfers are processed first, since IN transfers are usually submitted ahead of the commands that produce their data
+                libusb_transfer *transfer = pendingOut_.front();
+                pendingOut_.pop_front();
+                if (!connected_) {
+                    finishTransfer(transfer, LIBUSB_TRANSFER_NO_DEVICE, 0, delay(now));
+                } else if (writeOut(transfer->buffer, transfer->length) == 0) {
+                    finishTransfer(transfer, LIBUSB_TRANSFER_COMPLETED, transfer->length, schedule(false, transfer->length));
+                } else {
+                    finishTransfer(transfer, LIBUSB_TRANSFER_STALL, 0, schedule(false, 0));
+                }
+                progress = true;
+            }
+            if (!pendingIn_.empty() && (!connected_ || availableIn() > 0)) {
+                libusb_transfer *transfer = pendingIn_.front();
+                pendingIn_.pop_front();
+                if (!connected_) {
+                    finishTransfer(transfer, LIBUSB_TRANSFER_NO_DEVICE, 0, delay(now));
+                } else {
+                    int ntransferred = readIn(transfer->buffer, transfer->length);
+                    finishTransfer(transfer, LIBUSB_TRANSFER_COMPLETED, ntransferred, schedule(false, ntransferred));
+                }
+                progress = true;
+            }
+        }
+        if (completed_.empty() && !pendingIn_.empty() && pendingIn_.front()->timeout != 0) {
+            libusb_transfer *transfer = pendingIn_.front();
+            pendingIn_.pop_front();
+            finishTransfer(transfer, LIBUSB_TRANSFER_TIMED_OUT, 0, delay(latency_ == LATENCY_NONE ? now : now + std::chrono::milliseconds(transfer->timeout)));
+        }
+        changes = changeCount_;
+        pending = !completed_.empty();
+        if (pending) {
+            wakeup = completed_.front().due;
+        }
+    }
+    if (timeout != nullptr) {
+        std::chrono::steady_clock::time_point deadline = now + std::chrono::seconds(timeout->tv_sec) + std::chrono::microseconds(timeout->tv_usec);
+        if (!pending || wakeup > deadline) {  // If no transfer is due to complete, the whole timeout is waited for, as libusb would do
+            wakeup = deadline;
+        }
+    }
+    if (pending || timeout != nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stateChanged_.wait_until(lock, wakeup, [&] {
+            return changeCount_ != changes;  // Waiting also ends early if a transfer is submitted or cancelled, or if the simulated device changes state in the meantime
+        });
+    } else {  // Without a timeout, and with nothing due to complete, waiting only ends on a change
+        std::unique_lock<std::mutex> lock(mutex_);
+        stateChanged_.wait(lock, [&] {
+            return changeCount_ != changes;
+        });
+    }
+    bool delivering = true;
+    while (delivering) {  // The callbacks are called without holding the lock, since they may submit or cancel transfers
+        libusb_transfer *transfer = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!completed_.empty() && completed_.front().due <= std::chrono::steady_clock::now()) {
+                transfer = completed_.front().transfer;
+                completed_.pop_front();
+            }
+        }
+        if (transfer == nullptr) {
+            delivering = false;
+        } else {
+            transfer->callback(transfer);
+        }
+    }
+    return 0;
+}
+
+// Connects or disconnects the simulated device - While disconnected, every transfer fails with LIBUSB_ERROR_NO_DEVICE
+// Reconnecting the device resets it, as it would happen with a physical device
+void CP2130Simulator::setConnected(bool value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (value && !connected_) {
+        resetState();
+    }
+    connected_ = value;
+    notifyChange();
+}
+
+// Sets the current measured by the LTC2312, in mA (the ITUSB1 board yields a code of four times the current, up to 4095)
+// Note that the new value is only returned after the next conversion, as it would happen with a physical device
+void CP2130Simulator::setCurrent(float current)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    long code = std::lround(4 * current);
+    adcCode_ = static_cast<uint16_t>(code < 0 ? 0 : (code > ADC_MAXCODE ? ADC_MAXCODE : code));
+}
+
+// Sets the values driven externally on one or more GPIO pins, according to the values and mask bitmaps (see BMGPIO0 to BMGPIO10)
+// These values are only seen on pins configured as inputs (e.g., GPIO.3, which corresponds to the !UDOC signal on the ITUSB1 board)
+void CP2130Simulator::setGPIOInputs(uint16_t bmValues, uint16_t bmMask)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    gpioInputs_ = static_cast<uint16_t>((gpioInputs_ & ~bmMask) | (CP2130::BMGPIOS & bmValues & bmMask));
+}
+
+// Sets the latency model, which determines when transfers complete, and reseeds the jitter generator with the given seed
+// The simulated bus is assumed to be idle at this point, and frame boundaries are counted from this moment on
+void CP2130Simulator::setLatencyModel(const LatencyModel &model, uint32_t seed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    latency_ = model;
+    random_.seed(seed);
+    epoch_ = std::chrono::steady_clock::now();
+    busFree_ = epoch_;
+    lastDue_ = epoch_;
+    frame_ = -1;
+    framePacketCount_ = 0;
+}
+
+// Replaces the entire OTP ROM image, and then resets the simulated device
+void CP2130Simulator::setPROMConfig(const CP2130::PROMConfig &config)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < CP2130::PROM_SIZE; ++i) {
+        prom_[i] = config[i];
+    }
+    resetState();
+}
+
+// Sets the level of the RTR input, which allows ReadWithRTR commands to progress while active
+void CP2130Simulator::setRTR(bool value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    rtrActive_ = value;
+    notifyChange();
+}
+
+// Submits an asynchronous transfer (see CP2130Transport)
+int CP2130Simulator::submitTransfer(libusb_transfer *transfer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int result = 0;
+    if (!connected_) {
+        result = LIBUSB_ERROR_NO_DEVICE;
+    } else if (transfer->endpoint == endpointOutAddr()) {
+        pendingOut_.push_back(transfer);
+    } else if (transfer->endpoint == endpointInAddr()) {
+        pendingIn_.push_back(transfer);
+    } else {
+        result = LIBUSB_ERROR_PIPE;  // Nonexistent endpoint
+    }
+    if (result == 0) {
+        notifyChange();
+    }
+    return result;
+}
@@ -0,0 +1,151 @@
+/* CP2130 simulator class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+
+#ifndef CP2130SIMULATOR_H
+#define CP2130SIMULATOR_H
+
+// Includes
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "cp2130.h"
+#include "cp2130transport.h"
+
+// In-process simulation of a CP2130 bridge, to be passed to CP2130::open() or ITUSB1Device::open() instead of a physical device
+// The vendor requests, the OTP ROM and the Read, Write, WriteRead and ReadWithRTR bulk commands are modeled, along with an LTC2312 ADC on SPI channel 0, as found on the ITUSB1 board
+// All functions are thread-safe, and transfer callbacks are called from within handleEvents(), without holding any locks
+class CP2130Simulator : public CP2130Transport
+{
+private:
+    // Asynchronous transfer that completed or is due to complete
+    struct Completion {
+        libusb_transfer *transfer;                  // Asynchronous transfer whose callback is to be called
+        std::chrono::steady_clock::time_point due;  // Time at which the transfer completes
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable stateChanged_;      // Notified whenever an asynchronous transfer may be able to progress, so that handleEvents() stops waiting
+    unsigned long changeCount_;                 // Number of notifications so far
+    bool connected_;
+    uint8_t prom_[CP2130::PROM_SIZE];           // OTP ROM image, from which the USB configuration, descriptors, pin configuration and lock word are taken
+    uint8_t gpioModes_[11];                     // Current mode of each GPIO pin
+    uint16_t gpioLatch_;                        // Values last written to the GPIO pins (see BMGPIO0 to BMGPIO10)
+    uint16_t gpioInputs_;                       // Values driven externally on the GPIO pins, as seen by pins configured as inputs
+    uint16_t csEnabled_;                        // Bitmap of the SPI channels whose chip select is enabled
+    uint8_t spiWords_[11];                      // SPI control word of each channel
+    uint8_t spiDelays_[11][7];                  // SPI delay settings of each channel, as given to Set_SPI_Delay (enable mask, followed by three big-endian delays)
+    uint8_t fifoThreshold_;                     // Full FIFO threshold
+    uint8_t clockDivider_;                      // GPIO.5 clock divider
+    uint8_t eventCounterMode_;                  // GPIO.4/EVTCNTR pin mode
+    uint16_t eventCount_;                       // Event counter value
+    uint8_t command_;                           // Bulk command currently being executed
+    uint32_t writeRemaining_;                   // Payload bytes of the current Write or WriteRead command that are yet to be received
+    uint32_t readRemaining_;                    // Bytes of the current Read or ReadWithRTR command that are yet to be clocked in from the SPI bus
+    bool rtrActive_;                            // Level of the RTR input, which allows a ReadWithRTR command to progress
+    std::vector<uint8_t> inBuffer_;             // Data waiting to be read from the IN endpoint (i.e., read back by WriteRead commands)
+    size_t inHead_;                             // Index of the next byte of "inBuffer_" to be read
+    uint16_t adcCode_;                          // Code that the next LTC2312 conversion yields
+    uint16_t adcLatched_;                       // Code of the last LTC2312 conversion, which is shifted out during the following SPI frame
+    size_t frameBytes_;                         // Number of bytes clocked since the chip select was last asserted
+    std::deque<libusb_transfer *> pendingOut_;  // Asynchronous OUT transfers, in order of submission
+    std::deque<libusb_transfer *> pendingIn_;   // Asynchronous IN transfers, in order of submission
+
+    // Latency model state (see also the trailing private section)
+    std::mt19937 random_;                            // Generator used for jitter (seeded by setLatencyModel(), so that runs are reproducible)
+    std::chrono::steady_clock::time_point epoch_;    // Reference for frame boundaries
+    std::chrono::steady_clock::time_point busFree_;  // Time at which the bus becomes idle
+    std::chrono::steady_clock::time_point lastDue_;  // Completion time of the last transfer (completions are never reordered)
+    long long frame_;                                // Index of the frame in which the last bulk packet was sent
+    unsigned int framePacketCount_;                  // Number of bulk packets sent in that frame
+    std::deque<Completion> completed_;               // Asynchronous transfers that completed or are due to complete, in order
+
+    size_t availableIn() const;
+    uint8_t clockSPI();
+    void endFrame();
+    std::chrono::steady_clock::time_point delay(std::chrono::steady_clock::time_point time);
+    uint8_t endpointInAddr() const;
+    uint8_t endpointOutAddr() const;
+    void finishTransfer(libusb_transfer *transfer, libusb_transfer_status status, int actualLength, std::chrono::steady_clock::time_point due);
+    int getRequest(uint8_t bRequest, uint16_t wIndex, unsigned char *data, uint16_t wLength);
+    uint16_t inputPins() const;
+    unsigned int jitter();
+    uint16_t lockWord() const;
+    void notifyChange();
+    int readIn(unsigned char *data, int length);
+    void resetState();
+    std::chrono::steady_clock::time_point schedule(bool control, int length);
+    int setRequest(uint8_t bRequest, uint16_t wValue, uint16_t wIndex, const unsigned char *data, uint16_t wLength);
+    int writeOut(const unsigned char *data, int length);
+    void writeDescriptor(size_t index, size_t size, size_t nextIndex, size_t nextSize, const std::u16string &descriptor);
+
+public:
+    // Class definitions
+    static const size_t PACKET_SIZE = 64;       // Maximum packet size of the bulk endpoints
+    static const uint8_t JTNONE = 0x00;         // No jitter
+    static const uint8_t JTUNIFORM = 0x01;      // Jitter uniformly distributed between zero and the given amount
+    static const uint8_t JTEXPONENTIAL = 0x02;  // Exponentially distributed jitter, with a mean of the given amount (this has a long tail, like the scheduling delays of a loaded host)
+
+    struct LatencyModel {
+        unsigned int frameInterval;    // Frame interval in microseconds (a transfer that finds the bus idle only starts at the next frame boundary), or zero to disable frame scheduling
+        unsigned int controlOverhead;  // Time taken by each control transfer, from the start of its setup stage to the end of its status stage (in microseconds)
+        unsigned int packetTime;       // Time taken by each bulk packet (in microseconds)
+        unsigned int framePackets;     // Maximum number of bulk packets per frame, or zero for no limit
+        uint8_t jitter;                // Jitter distribution, applied to the completion of each transfer (see JTNONE, JTUNIFORM and JTEXPONENTIAL)
+        unsigned int jitterAmount;     // Jitter amount in microseconds (maximum for JTUNIFORM, or mean for JTEXPONENTIAL)
+
+        bool operator ==(const LatencyModel &other) const;
+        bool operator !=(const LatencyModel &other) const;
+    };
+
+    static const LatencyModel LATENCY_NONE;        // Transfers complete instantly (used by default)
+    static const LatencyModel LATENCY_FULL_SPEED;  // Typical latencies of a CP2130 on a full-speed bus
+
+    explicit CP2130Simulator(uint16_t vid = CP2130::VID, uint16_t pid = CP2130::PID, const std::u16string &serial = u"SIM00001");
+
+    uint16_t gpioOutputs() const;
+    bool isConnected() const;
+    LatencyModel latencyModel() const;
+    CP2130::PROMConfig promConfig() const;
+
+    int bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length, int *transferred, unsigned int timeout);
+    int cancelTransfer(libusb_transfer *transfer);
+    int controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout);
+    int handleEvents(timeval *timeout);
+    void setConnected(bool value);
+    void setCurrent(float current);
+    void setGPIOInputs(uint16_t bmValues, uint16_t bmMask);
+    void setLatencyModel(const LatencyModel &model, uint32_t seed = std::mt19937::default_seed);
+    void setPROMConfig(const CP2130::PROMConfig &config);
+    void setRTR(bool value);
+    int submitTransfer(libusb_transfer *transfer);
+
+private:
+    // Latency model (declared here, since it depends on the above types)
+    LatencyModel latency_;
+};
+
+#endif  // CP2130SIMULATOR_H
@@ -0,0 +1,44 @@
+/* CP2130 transport interface - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+
+#ifndef CP2130TRANSPORT_H
+#define CP2130TRANSPORT_H
+
+// Includes
+#include <cstdint>
+#include <libusb-1.0/libusb.h>
+
+// Interface through which a CP2130 object may issue its transfers, instead of using libusb directly (see CP2130::open())
+// Every function follows the semantics and return values of its libusb counterpart, so that the CP2130 class handles both cases alike
+// Asynchronous transfers are allocated and filled by the CP2130 class, as usual, and the transport must call their callbacks from within handleEvents()
+class CP2130Transport
+{
+public:
+    virtual ~CP2130Transport() {}
+
+    virtual int bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length, int *transferred, unsigned int timeout) = 0;  // Counterpart of libusb_bulk_transfer()
+    virtual int cancelTransfer(libusb_transfer *transfer) = 0;  // Counterpart of libusb_cancel_transfer()
+    virtual int controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout) = 0;  // Counterpart of libusb_control_transfer()
+    virtual int handleEvents(timeval *timeout) = 0;  // Counterpart of libusb_handle_events_timeout_completed()
+    virtual int submitTransfer(libusb_transfer *transfer) = 0;  // Counterpart of libusb_submit_transfer()
+};
+
+#endif  // CP2130TRANSPORT_H
@@ -0,0 +1,291 @@
+/* ITUSB1 benchmark - Version 1.0.0
+   Requires CP2130 simulator class version 1.0.0 or later
+   Copyright (c) 2026 Samuel Lourenço
+
+   This program is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+// Benchmark of the hot paths of the CP2130 and ITUSB1Device classes, run against a CP2130Simulator object
+// Usage: itusb1bench [--json] [--latency none|fullspeed] [--iterations N]
+// For each operation, the throughput, the median and 99th percentile latencies, and the number of USB transactions and heap allocations per operation are reported
+// With --json, the results are written as a single JSON document instead of a table, so that they can be compared between builds
+
+// Includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include "cp2130simulator.h"
+#include "itusb1device.h"
+#include "usbcontext.h"
+
+// Definitions
+const uint8_t EPIN = 0x82;                         // Address of endpoint assuming the IN direction
+const uint8_t EPOUT = 0x01;                        // Address of endpoint assuming the OUT direction
+const uint32_t SPI_SIZES[4] = {2, 64, 512, 4096};  // Transfer sizes used by the SPI benchmarks (in bytes)
+const size_t DEFAULT_ITERATIONS = 200;             // Iterations per benchmark, unless specified otherwise
+const ITUSB1Device::TimingProfile TIMING_BENCHMARK = {
+    0,    // The power sequencing delays are skipped, since they would dominate the attach and detach benchmark
+    0,
+    0,
+    0,
+    100,  // The chip select and wake-up delays are kept, since they are part of every current reading
+    1100
+};
+
+std::atomic<unsigned long long> allocations(0);  // Count of heap allocations made via operator new (see below)
+
+// Transport that forwards everything to another transport, while counting the USB transactions (i.e., control transfers and bulk transfers, either synchronous or asynchronous)
+class CountingTransport : public CP2130Transport
+{
+private:
+    CP2130Transport &transport_;
+    unsigned long long transactions_;
+
+public:
+    explicit CountingTransport(CP2130Transport &transport) :
+        transport_(transport),
+        transactions_(0)
+    {
+    }
+
+    // Returns the number of USB transactions so far
+    unsigned long long transactions() const
+    {
+        return transactions_;
+    }
+
+    int bulkTransfer(uint8_t endpointAddr, unsigned char *data, int length, int *transferred, unsigned int timeout)
+    {
+        ++transactions_;
+        return transport_.bulkTransfer(endpointAddr, data, length, transferred, timeout);
+    }
+
+    int cancelTransfer(libusb_transfer *transfer)
+    {
+        return transport_.cancelTransfer(transfer);
+    }
+
+    int controlTransfer(uint8_t bmRequestType, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, unsigned char *data, uint16_t wLength, unsigned int timeout)
+    {
+        ++transactions_;
+        return transport_.controlTransfer(bmRequestType, bRequest, wValue, wIndex, data, wLength, timeout);
+    }
+
+    int handleEvents(timeval *timeout)
+    {
+        return transport_.handleEvents(timeout);
+    }
+
+    int submitTransfer(libusb_transfer *transfer)
+    {
+        ++transactions_;
+        return transport_.submitTransfer(transfer);
+    }
+};
+
+struct Result {
+    std::string name;     // Name of the operation
+    uint32_t bytes;       // Payload bytes per operation, or zero if not applicable
+    size_t iterations;    // Number of measured iterations
+    double seconds;       // Total time taken by the measured iterations
+    double p50;           // Median latency (in microseconds)
+    double p99;           // 99th percentile latency (in microseconds)
+    double transactions;  // USB transactions per operation
+    double allocations;   // Heap allocations per operation
+    int errcnt;           // Number of errors that occurred
+};
+
+typedef std::function<void(int &errcnt, std::string &errstr)> Operation;
+
+// Replacement of the global operator new, so that heap allocations can be counted (the remaining forms of operator new and operator delete use these by default)
+void *operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *pointer = std::malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+// Replacement of the global operator delete, matching the above
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+// Returns the given percentile of the given latencies, which must be sorted
+double percentile(const std::vector<double> &sorted, double fraction)
+{
+    return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+}
+
+// Runs the given operation for the given number of iterations, after a warm-up iteration, and returns the results
+Result benchmark(const std::string &name, uint32_t bytes, size_t iterations, const CountingTransport &transport, const Operation &operation)
+{
+    Result result;
+    result.name = name;
+    result.bytes = bytes;
+    result.iterations = iterations;
+    std::vector<double> latencies;
+    latencies.reserve(iterations);  // Reserved beforehand, so that it does not count as an allocation
+    int errcnt = 0;
+    std::string errstr;
+    errstr.reserve(4096);
+    operation(errcnt, errstr);  // Warm-up iteration, so that one-time allocations are excluded
+    errcnt = 0;
+    errstr.clear();
+    unsigned long long transactions = transport.transactions();
+    unsigned long long allocationsBefore = allocations.load(std::memory_order_relaxed);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        operation(errcnt, errstr);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count());
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.allocations = static_cast<double>(allocations.load(std::memory_order_relaxed) - allocationsBefore) / iterations;
+    result.transactions = static_cast<double>(transport.transactions() - transactions) / iterations;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = percentile(latencies, 0.50);
+    result.p99 = percentile(latencies, 0.99);
+    result.errcnt = errcnt;
+    if (errcnt > 0) {
+        std::fprintf(stderr, "%s: %s", name.c_str(), errstr.c_str());
+    }
+    return result;
+}
+
+// Prints the given results as a table
+void printTable(const std::vector<Result> &results, const std::string &latency)
+{
+    std::printf("Latency model: %s\n\n", latency.c_str());
+    std::printf("%-22s %8s %12s %12s %10s %10s %8s %8s %6s\n", "operation", "bytes", "ops/s", "kB/s", "p50 (us)", "p99 (us)", "xfer/op", "alloc/op", "errors");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        double rate = result.iterations / result.seconds;
+        std::printf("%-22s %8u %12.1f %12.1f %10.1f %10.1f %8.2f %8.2f %6d\n", result.name.c_str(), result.bytes, rate, rate * result.bytes / 1000, result.p50, result.p99, result.transactions, result.allocations, result.errcnt);
+    }
+}
+
+// Prints the given results as a JSON document
+void printJSON(const std::vector<Result> &results, const std::string &latency)
+{
+    std::printf("{\n  \"benchmark\": \"itusb1bench\",\n  \"version\": \"1.0.0\",\n  \"latency_model\": \"%s\",\n  \"results\": [\n", latency.c_str());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        double rate = result.iterations / result.seconds;
+        std::printf("    {\"name\": \"%s\", \"bytes\": %u, \"iterations\": %zu, \"ops_per_sec\": %.3f, \"bytes_per_sec\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"transactions_per_op\": %.3f, \"allocations_per_op\": %.3f, \"errors\": %d}%s\n",
+                    result.name.c_str(), result.bytes, result.iterations, rate, rate * result.bytes, result.p50, result.p99, result.transactions, result.allocations, result.errcnt, i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool json = false;
+    std::string latency = "fullspeed";
+    size_t iterations = DEFAULT_ITERATIONS;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (std::strcmp(argv[i], "--latency") == 0 && i + 1 < argc && (std::strcmp(argv[i + 1], "none") == 0 || std::strcmp(argv[i + 1], "fullspeed") == 0)) {
+            latency = argv[++i];
+        } else if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc && std::atol(argv[i + 1]) > 0) {
+            iterations = static_cast<size_t>(std::atol(argv[++i]));
+        } else {
+            std::fprintf(stderr, "Usage: %s [--json] [--latency none|fullspeed] [--iterations N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    CP2130Simulator simulator(ITUSB1Device::VID, ITUSB1Device::PID);
+    simulator.setCurrent(100.0f);
+    simulator.setLatencyModel(latency == "none" ? CP2130Simulator::LATENCY_NONE : CP2130Simulator::LATENCY_FULL_SPEED);
+    CountingTransport transport(simulator);
+    ITUSB1Device device;
+    int errcnt = 0;
+    std::string errstr;
+    if (device.open(transport) != ITUSB1Device::SUCCESS) {
+        std::fprintf(stderr, "Could not open the simulated device.\n");
+        return EXIT_FAILURE;
+    }
+    device.setTimingProfile(TIMING_BENCHMARK);
+    device.setup(errcnt, errstr);
+    CP2130 cp2130;  // Used for the benchmarks that target the CP2130 class directly, through the same simulated device
+    cp2130.open(transport);
+    if (errcnt > 0) {
+        std::fprintf(stderr, "%s", errstr.c_str());
+        return EXIT_FAILURE;
+    }
+    std::vector<Result> results;
+    std::vector<uint8_t> buffer(SPI_SIZES[3]);
+    for (size_t i = 0; i < sizeof(SPI_SIZES) / sizeof(SPI_SIZES[0]); ++i) {
+        uint32_t size = SPI_SIZES[i];
+        std::vector<uint8_t> data(size, 0x55);
+        results.push_back(benchmark("spiRead", size, iterations, transport, [&cp2130, &buffer, size](int &errcnt, std::string &errstr) {
+            cp2130.spiRead(buffer.data(), size, EPIN, EPOUT, errcnt, errstr);
+        }));
+        results.push_back(benchmark("spiWrite", size, iterations, transport, [&cp2130, &data](int &errcnt, std::string &errstr) {
+            cp2130.spiWrite(data, EPOUT, errcnt, errstr);
+        }));
+        results.push_back(benchmark("spiWriteRead", size, iterations, transport, [&cp2130, &data](int &errcnt, std::string &errstr) {
+            cp2130.spiWriteRead(data, EPIN, EPOUT, errcnt, errstr);
+        }));
+    }
+    results.push_back(benchmark("getGPIOs", 0, iterations, transport, [&cp2130](int &errcnt, std::string &errstr) {
+        cp2130.getGPIOs(errcnt, errstr);
+    }));
+    results.push_back(benchmark("getCurrent", 0, iterations, transport, [&device](int &errcnt, std::string &errstr) {
+        device.getCurrent(errcnt, errstr);
+    }));
+    results.push_back(benchmark("attach+detach", 0, iterations, transport, [&device](int &errcnt, std::string &errstr) {  // A full cycle is measured, since attaching an already attached DUT does nothing
+        device.attach(errcnt, errstr);
+        device.detach(errcnt, errstr);
+    }));
+    cp2130.close();
+    results.push_back(benchmark("open", 0, iterations, transport, [&cp2130, &transport](int &errcnt, std::string &errstr) {
+        if (cp2130.open(transport) != CP2130::SUCCESS) {
+            ++errcnt;
+            errstr += "Could not open the simulated device.\n";
+        }
+        cp2130.close();
+    }));
+    USBContext context;  // The simulated device is not visible to libusb, so this only measures the enumeration of the devices that are actually connected
+    if (!context.isNull()) {
+        results.push_back(benchmark("listDevices", 0, iterations, transport, [&context](int &errcnt, std::string &errstr) {
+            ITUSB1Device::listDevices(context, errcnt, errstr);
+        }));
+    }
+    device.close();
+    if (json) {
+        printJSON(results, latency);
+    } else {
+        printTable(results, latency);
+    }
+    int errors = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        errors += results[i].errcnt;
+    }
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
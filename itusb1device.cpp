@@ -1,6 +1,6 @@
-/* ITUSB1 device class - Version 1.2.3
-   Requires CP2130 class version 1.1.0 or later
-   Copyright (c) 2021-2022 Samuel Lourenço
+/* ITUSB1 device class - Version 1.3.0
+   Requires CP2130 class version 1.3.0 or later
+   Copyright (c) 2021-2026 Samuel Lourenço
 
    This library is free software: you can redistribute it and/or modify it
    under the terms of the GNU Lesser General Public License as published by
@@ -20,7 +20,9 @@
 
 
 // Includes
+#include <algorithm>
 #include <sstream>
+#include <thread>
 #include <unistd.h>
 #include <vector>
 #include "itusb1device.h"
@@ -29,65 +31,513 @@
 const uint8_t EPIN = 0x82;   // Address of endpoint assuming the IN direction
 const uint8_t EPOUT = 0x01;  // Address of endpoint assuming the OUT direction
 const size_t N_SAMPLES = 5;  // Number of samples per measurement, applicable to getCurrent()
+const size_t N_COARSE_BYTES = 2;    // Number of bytes read per measurement, applicable to getCurrentCoarse() (the first byte flushes a past conversion, and only the second one is used)
+
+// Parameters used by measureTiming()
+const float CAL_RISE_THRESHOLD = 8.0;      // Minimum increase of VBUS current, relative to the current measured before switching VBUS on, for the DUT to be considered powered (in mA)
+const float CAL_SETTLE_TOLERANCE = 2.0;    // Maximum variation between consecutive current measurements, for VBUS current to be considered settled (in mA)
+const unsigned int CAL_TIMEOUT = 1000000;  // Maximum time allowed for VBUS current to rise and settle (in microseconds)
+
+// Steps of the attach/detach sequencer, applicable to advanceSequence()
+const int SEQ_IDLE = 0;             // No sequence active
+const int SEQ_ATTACH_SHUTDOWN = 1;  // Waiting for device shutdown, after switching VBUS off and disconnecting the data lines
+const int SEQ_ATTACH_POWER = 2;     // Waiting after switching VBUS on, before connecting the data lines
+const int SEQ_ATTACH_DATA = 3;      // Waiting after connecting the data lines, so that device enumeration can start
+const int SEQ_DETACH_DATA = 4;      // Waiting after disconnecting the data lines, before switching VBUS off
+const int SEQ_DETACH_POWER = 5;     // Waiting for device shutdown, after switching VBUS off
+
+// Private structure that holds the buffers used by readRawCurrentAsync(), which must remain valid until both transfers complete
+struct ITUSB1Device::AsyncReading {
+    unsigned char command[8];  // Read command
+    unsigned char data[2];     // Raw reading
+    bool abandoned;            // Set if the read command could not be submitted, in which case the callback is not called
+};
+
+// Private structure that holds the state of attachAndWait(), which is shared with enumerationCallback()
+struct ITUSB1Device::EnumerationWait {
+    int completed;                                  // Set to one when the DUT enumerates (an int is used, as required by libusb_handle_events_timeout_completed())
+    std::chrono::steady_clock::time_point arrival;  // Time at which the DUT enumerated
+};
+
+// Private procedure used to end the current attach/detach sequence, calling the respective callback
+void ITUSB1Device::finishSequence()
+{
+    sequenceStep_ = SEQ_IDLE;
+    SequenceCallback callback = sequenceCallback_;  // The callback is copied, since it may start a new sequence
+    int errcnt = sequenceErrcnt_;
+    std::string errstr = sequenceErrstr_;
+    sequenceCallback_ = nullptr;
+    sequenceErrcnt_ = 0;
+    sequenceErrstr_.clear();
+    if (callback) {
+        callback(errcnt, errstr);
+    }
+}
+
+// Private procedure that runs on the sampler thread, reading the LTC2312 at the given interval (in microseconds) until stopSampler() is called or the device is disconnected
+void ITUSB1Device::runSampler(unsigned int interval)
+{
+    int errcnt = 0;
+    std::string errstr;
+    unsigned int csDelay = timing_.csDelay;  // The timing profile is copied, since it should not be accessed from the sampler thread afterwards
+    cp2130_.selectCS(0, errcnt, errstr);  // Enable the chip select corresponding to channel 0, and disable any others
+    usleep(csDelay);  // Wait (100us by default), in order to prevent possible errors after enabling the chip select (workaround)
+    getRawCurrent(errcnt, errstr);  // Discard this reading, as it will reflect a past measurement
+    std::chrono::steady_clock::time_point conversion = std::chrono::steady_clock::now();  // Each reading reflects the conversion triggered at the end of the previous one
+    std::chrono::steady_clock::time_point next = conversion;
+    while (!samplerStop_.load(std::memory_order_acquire) && !cp2130_.disconnected()) {
+        next += std::chrono::microseconds(interval);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (next < now) {  // If the sampler fell behind (e.g., because a reading took longer than the interval), the schedule is resynchronized instead of trying to catch up
+            next = now;
+        }
+        std::this_thread::sleep_until(next);
+        int preverrcnt = errcnt;
+        Sample sample;
+        sample.code = getRawCurrent(errcnt, errstr);
+        sample.timestamp = conversion;
+        conversion = std::chrono::steady_clock::now();
+        if (errcnt == preverrcnt && !samples_.push(sample)) {  // If the ring buffer is full, the newest sample is dropped, since the consumer is not keeping up
+            droppedSamples_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    usleep(csDelay);  // Wait (100us by default), in order to prevent possible errors while disabling the chip select (workaround)
+    cp2130_.disableCS(0, errcnt, errstr);  // Disable the previously enabled chip select
+    samplerErrcnt_ = errcnt;  // These are only read by stopSampler(), after the thread is joined
+    samplerErrstr_ = errstr;
+    samplerActive_.store(false, std::memory_order_release);
+}
+
+// Private procedure used to move the attach/detach sequence to the given step, which ends after the given delay (in microseconds)
+void ITUSB1Device::scheduleSequenceStep(int step, unsigned int delay)
+{
+    sequenceStep_ = step;
+    sequenceDeadline_ = std::chrono::steady_clock::now() + std::chrono::microseconds(delay);
+}
+
+// Private procedure used to wait for the given delay (in microseconds), which is always taken from the timing profile
+void ITUSB1Device::sleepFor(unsigned int delay)
+{
+    if (delay > 0) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        usleep(delay);
+        cp2130_.addTraceEvent("sleep", "sleepFor", begin, std::chrono::steady_clock::now());
+    }
+}
+
+// Private callback function that is called by libusb whenever a matching device arrives, while attachAndWait() is waiting for the DUT to enumerate
+int LIBUSB_CALL ITUSB1Device::enumerationCallback(libusb_context *, libusb_device *, libusb_hotplug_event, void *userData)
+{
+    EnumerationWait *wait = static_cast<EnumerationWait *>(userData);
+    if (wait->completed == 0) {  // Only the first arrival counts
+        wait->arrival = std::chrono::steady_clock::now();
+        wait->completed = 1;
+    }
+    return 0;  // Keep the callback registered, since it is deregistered by attachAndWait()
+}
 
 // Private convenience function that is used to get the raw current measurement reading from the LTC2312 ADC
 uint16_t ITUSB1Device::getRawCurrent(int &errcnt, std::string &errstr)
 {
-    std::vector<uint8_t> read = cp2130_.spiRead(2, EPIN, EPOUT, errcnt, errstr);
-    return read.size() == 2 ? static_cast<uint16_t>(read[0] << 4 | read[1] >> 4) : 0;  // It is important to check if the size of the returned vector matches the number of expected bytes - If not, return zero!
+    uint8_t read[2];
+    return cp2130_.spiRead(read, 2, EPIN, EPOUT, errcnt, errstr) == 2 ? static_cast<uint16_t>(read[0] << 4 | read[1] >> 4) : 0;  // It is important to check if the number of bytes read matches the number of expected bytes - If not, return zero!
+}
+
+// "Equal to" operator for TimingProfile
+bool ITUSB1Device::TimingProfile::operator ==(const ITUSB1Device::TimingProfile &other) const
+{
+    return powerOnDelay == other.powerOnDelay && enumerationDelay == other.enumerationDelay && dataOffDelay == other.dataOffDelay && shutdownDelay == other.shutdownDelay && csDelay == other.csDelay && wakeupDelay == other.wakeupDelay;
+}
+
+// "Not equal to" operator for TimingProfile
+bool ITUSB1Device::TimingProfile::operator !=(const ITUSB1Device::TimingProfile &other) const
+{
+    return !(operator ==(other));
+}
+
+// "Equal to" operator for DeviceInfo
+bool ITUSB1Device::DeviceInfo::operator ==(const ITUSB1Device::DeviceInfo &other) const
+{
+    return serial == other.serial && bus == other.bus && ports == other.ports && address == other.address && hardwareRevision == other.hardwareRevision && silicon == other.silicon;
+}
+
+// "Not equal to" operator for DeviceInfo
+bool ITUSB1Device::DeviceInfo::operator !=(const ITUSB1Device::DeviceInfo &other) const
+{
+    return !(operator ==(other));
 }
 
+// Built-in timing profiles
+const ITUSB1Device::TimingProfile ITUSB1Device::TIMING_DEFAULT = {
+    100000,  // Wait 100ms after switching VBUS on, in order to emulate a manual attachment of the device
+    100000,  // Wait 100ms after connecting the data lines, so that device enumeration process can, at least, start
+    100000,  // Wait 100ms after disconnecting the data lines, in order to emulate a manual detachment of the device
+    100000,  // Wait 100ms after switching VBUS off, to allow for device shutdown
+    100,     // Wait 100us after enabling and before disabling the chip select (workaround implemented in version 1.2.3)
+    1100     // Wait 1.1ms to ensure that the LTC2312 is awake
+};
+const ITUSB1Device::TimingProfile ITUSB1Device::TIMING_FAST = {
+    10000,  // 10ms are usually enough for VBUS to rise and settle
+    10000,  // As with the default profile, this does not guarantee enumeration
+    1000,   // The host only needs to notice the disconnection before VBUS is switched off
+    20000,  // Enough for VBUS to discharge, when the DUT has little bulk capacitance
+    20,     // Shorter chip select workaround delay
+    1100    // The LTC2312 wake-up time is fixed, as per the datasheet
+};
+
 ITUSB1Device::ITUSB1Device() :
-    cp2130_()
+    ITUSB1Device(USBContext(nullptr))
 {
 }
 
+// Constructs an object that uses the given context, which may be shared with other ITUSB1Device or CP2130 objects
+// A null context is equivalent to none, as with the default constructor
+ITUSB1Device::ITUSB1Device(const USBContext &context) :
+    cp2130_(context),
+    burstDelays_(false),
+    autoReconnectSuspended_(false),
+    samplerThread_(),
+    samplerActive_(false),
+    samplerStop_(false),
+    droppedSamples_(0),
+    samplerErrcnt_(0),
+    samplerErrstr_(),
+    sequenceStep_(SEQ_IDLE),
+    sequencePower_(false),
+    sequenceDeadline_(),
+    sequenceErrcnt_(0),
+    sequenceErrstr_(),
+    samples_(SAMPLER_BUFFER_SIZE),
+    sequenceCallback_(),
+    timing_(TIMING_DEFAULT)
+{
+}
+
+ITUSB1Device::~ITUSB1Device()
+{
+    int errcnt = 0;
+    std::string errstr;
+    stopSampler(errcnt, errstr);  // The sampler thread must be stopped before the object is destroyed
+}
+
 // Diagnostic function used to verify if the device has been disconnected
 bool ITUSB1Device::disconnected() const
 {
     return cp2130_.disconnected();
 }
 
+// Returns the number of samples that were dropped by the sampler because the ring buffer was full
+size_t ITUSB1Device::droppedSamples() const
+{
+    return droppedSamples_.load(std::memory_order_relaxed);
+}
+
 // Checks if the device is open
 bool ITUSB1Device::isOpen() const
 {
     return cp2130_.isOpen();
 }
 
+// Checks if an attach/detach sequence started by beginAttach() or beginDetach() is still active
+bool ITUSB1Device::isSequenceActive() const
+{
+    return sequenceStep_ != SEQ_IDLE;
+}
+
+// Checks if tracing is enabled
+bool ITUSB1Device::isTracingEnabled() const
+{
+    return cp2130_.isTracingEnabled();
+}
+
+// Returns the number of trace events that were overwritten because the trace ring was full (see CP2130::lostTraceEvents())
+size_t ITUSB1Device::lostTraceEvents() const
+{
+    return cp2130_.lostTraceEvents();
+}
+
+// Checks if the sampler is running (the sampler stops by itself if the device is disconnected)
+bool ITUSB1Device::isSamplerRunning() const
+{
+    return samplerActive_.load(std::memory_order_acquire);
+}
+
+// Returns the USB transfer timeouts in use
+CP2130::Timeouts ITUSB1Device::timeouts() const
+{
+    return cp2130_.timeouts();
+}
+
+// Returns the timing profile in use
+ITUSB1Device::TimingProfile ITUSB1Device::timingProfile() const
+{
+    return timing_;
+}
+
+// Returns the trace as a JSON document in the Chrome trace event format (see CP2130::traceJSON())
+// Besides the transfers, the trace includes the waits and the main operations of this class (i.e., attach(), detach(), getCurrent() and setup())
+std::string ITUSB1Device::traceJSON() const
+{
+    return cp2130_.traceJSON();
+}
+
+// Returns a snapshot of the transfer statistics of the underlying CP2130 (see CP2130::transferStats())
+std::vector<CP2130::TransferStats> ITUSB1Device::transferStats() const
+{
+    return cp2130_.transferStats();
+}
+
+// Advances the attach/detach sequence, if the current step has ended, and returns true if the sequence is still active
+// This function never blocks, and it is meant to be called from an event loop, ideally as soon as sequenceDeadline() is reached
+bool ITUSB1Device::advanceSequence()
+{
+    if (sequenceStep_ != SEQ_IDLE && std::chrono::steady_clock::now() >= sequenceDeadline_) {
+        switch (sequenceStep_) {
+            case SEQ_ATTACH_SHUTDOWN:
+            case SEQ_ATTACH_POWER:
+                if (sequenceStep_ == SEQ_ATTACH_SHUTDOWN) {
+                    switchUSBPower(true, sequenceErrcnt_, sequenceErrstr_);  // Switch VBUS on
+                    scheduleSequenceStep(SEQ_ATTACH_POWER, timing_.powerOnDelay);  // Wait (100ms by default) in order to emulate a manual attachment of the device
+                } else {
+                    switchUSBData(true, sequenceErrcnt_, sequenceErrstr_);  // Connect the data lines
+                    scheduleSequenceStep(SEQ_ATTACH_DATA, timing_.enumerationDelay);  // Wait (100ms by default) so that device enumeration process can, at least, start (this is not enough to guarantee enumeration, though)
+                }
+                break;
+            case SEQ_DETACH_DATA:
+                if (sequencePower_) {  // If VBUS is switched on
+                    switchUSBPower(false, sequenceErrcnt_, sequenceErrstr_);  // Switch VBUS off
+                    scheduleSequenceStep(SEQ_DETACH_POWER, timing_.shutdownDelay);  // Wait (100ms by default) to allow for device shutdown
+                } else {
+                    finishSequence();
+                }
+                break;
+            default:  // SEQ_ATTACH_DATA or SEQ_DETACH_POWER
+                finishSequence();
+                break;
+        }
+    }
+    return sequenceStep_ != SEQ_IDLE;
+}
+
 // Attaches the DUT (device under test) to the HUT (host under test)
+// This function blocks until the sequence ends (see beginAttach() for a non-blocking alternative)
 void ITUSB1Device::attach(int &errcnt, std::string &errstr)
 {
-    if (getUSBPowerStatus(errcnt, errstr) != getUSBDataStatus(errcnt, errstr)) {  // If true, this condition indicates an unusual state
-        switchUSB(false, errcnt, errstr);  // Switch VBUS off and disconnect the data lines
-        usleep(100000);  // Wait 100ms to allow for device shutdown
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    beginAttach([&errcnt, &errstr](int seqErrcnt, const std::string &seqErrstr) {
+        errcnt += seqErrcnt;
+        errstr += seqErrstr;
+    }, errcnt, errstr);
+    while (advanceSequence()) {
+        std::chrono::steady_clock::time_point waitBegin = std::chrono::steady_clock::now();
+        std::this_thread::sleep_until(sequenceDeadline_);
+        cp2130_.addTraceEvent("sleep", "sequenceWait", waitBegin, std::chrono::steady_clock::now());
     }
-    if (!getUSBPowerStatus(errcnt, errstr) && !getUSBDataStatus(errcnt, errstr)) {  // If both VBUS and data lines are disconnected
+    cp2130_.addTraceEvent("operation", "attach", begin, std::chrono::steady_clock::now());
+}
+
+// Attaches the DUT (device under test) to the HUT (host under test), and waits until the DUT enumerates or the given timeout (in milliseconds) expires
+// Enumeration is detected using libusb hotplug events within the context of the device, so the HUT must be the host that controls the ITUSB1 device
+// The DUT is matched by its VID and PID (either can be ANY_ID), and it is always detached first, so that a fresh enumeration is measured
+// Returns the enumeration latency, measured from the moment the data lines are connected, or zero in case of failure
+std::chrono::microseconds ITUSB1Device::attachAndWait(int vid, int pid, unsigned int timeout, int &errcnt, std::string &errstr)
+{
+    std::chrono::microseconds latency(0);
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In attachAndWait(): device is not open.\n";  // Program logic error
+    } else if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) == 0) {
+        ++errcnt;
+        errstr += "Hotplug events are not supported on this platform.\n";
+    } else {
+        USBContext context = cp2130_.context();
+        int preverrcnt = errcnt;
+        detach(errcnt, errstr);
         switchUSBPower(true, errcnt, errstr);  // Switch VBUS on
-        usleep(100000);  // Wait 100ms in order to emulate a manual attachment of the device
-        switchUSBData(true, errcnt, errstr);  // Connect the data lines
-        usleep(100000);  // Wait 100ms so that device enumeration process can, at least, start (this is not enough to guarantee enumeration, though)
+        sleepFor(timing_.powerOnDelay);  // Wait (100ms by default) in order to emulate a manual attachment of the device
+        EnumerationWait wait;
+        wait.completed = 0;
+        libusb_hotplug_callback_handle callbackHandle;
+        if (errcnt == preverrcnt && libusb_hotplug_register_callback(context.get(), LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, LIBUSB_HOTPLUG_NO_FLAGS, vid, pid, LIBUSB_HOTPLUG_MATCH_ANY, enumerationCallback, &wait, &callbackHandle) != 0) {  // The callback is registered before connecting the data lines, so that no arrival is missed
+            ++errcnt;
+            errstr += "Failed to register hotplug callback.\n";
+        } else if (errcnt == preverrcnt) {
+            switchUSBData(true, errcnt, errstr);  // Connect the data lines
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::chrono::steady_clock::time_point deadline = start + std::chrono::milliseconds(timeout);
+            while (errcnt == preverrcnt && wait.completed == 0 && std::chrono::steady_clock::now() < deadline) {
+                long long remaining = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remaining < 0) {  // The deadline may pass after being checked, and libusb rejects negative timeouts
+                    remaining = 0;
+                }
+                timeval tv = {static_cast<time_t>(remaining / 1000000), static_cast<suseconds_t>(remaining % 1000000)};
+                if (libusb_handle_events_timeout_completed(context.get(), &tv, &wait.completed) != 0) {
+                    ++errcnt;
+                    errstr += "Failed to handle USB events.\n";
+                }
+            }
+            libusb_hotplug_deregister_callback(context.get(), callbackHandle);
+            if (wait.completed != 0) {
+                latency = std::chrono::duration_cast<std::chrono::microseconds>(wait.arrival - start);
+            } else if (errcnt == preverrcnt) {
+                ++errcnt;
+                errstr += "DUT did not enumerate within the given timeout.\n";
+            }
+        }
+    }
+    return latency;
+}
+
+// Starts attaching the DUT (device under test) to the HUT (host under test), and returns immediately
+// The sequence is then driven by advanceSequence(), and the given callback is called once it ends
+void ITUSB1Device::beginAttach(const SequenceCallback &callback, int &errcnt, std::string &errstr)
+{
+    if (sequenceStep_ != SEQ_IDLE) {
+        ++errcnt;
+        errstr += "In beginAttach(): another sequence is still active.\n";  // Program logic error
+    } else {
+        sequenceCallback_ = callback;
+        CP2130::GPIOSnapshot gpios = cp2130_.getGPIOSnapshot(sequenceErrcnt_, sequenceErrstr_);  // A single snapshot is used to get the status of both VBUS and data lines
+        bool power = !gpios.gpio1(), data = !gpios.gpio2();  // Negated !UPEN and !UDEN signals, respectively
+        if (power != data) {  // If true, this condition indicates an unusual state
+            switchUSB(false, sequenceErrcnt_, sequenceErrstr_);  // Switch VBUS off and disconnect the data lines
+            scheduleSequenceStep(SEQ_ATTACH_SHUTDOWN, timing_.shutdownDelay);  // Wait (100ms by default) to allow for device shutdown
+        } else if (!power && !data) {  // If both VBUS and data lines are disconnected
+            switchUSBPower(true, sequenceErrcnt_, sequenceErrstr_);  // Switch VBUS on
+            scheduleSequenceStep(SEQ_ATTACH_POWER, timing_.powerOnDelay);  // Wait (100ms by default) in order to emulate a manual attachment of the device
+        } else {  // Already attached
+            finishSequence();
+        }
     }
 }
 
+// Starts detaching the DUT (device under test) from the HUT (host under test), and returns immediately
+// The sequence is then driven by advanceSequence(), and the given callback is called once it ends
+void ITUSB1Device::beginDetach(const SequenceCallback &callback, int &errcnt, std::string &errstr)
+{
+    if (sequenceStep_ != SEQ_IDLE) {
+        ++errcnt;
+        errstr += "In beginDetach(): another sequence is still active.\n";  // Program logic error
+    } else {
+        sequenceCallback_ = callback;
+        CP2130::GPIOSnapshot gpios = cp2130_.getGPIOSnapshot(sequenceErrcnt_, sequenceErrstr_);  // A single snapshot is used to get the status of both VBUS and data lines
+        sequencePower_ = !gpios.gpio1();  // Negated !UPEN signal
+        if (!gpios.gpio2()) {  // If the data lines are connected (negated !UDEN signal)
+            switchUSBData(false, sequenceErrcnt_, sequenceErrstr_);  // Disconnect the data lines
+            scheduleSequenceStep(SEQ_DETACH_DATA, timing_.dataOffDelay);  // Wait (100ms by default) in order to emulate a manual detachment of the device
+        } else if (sequencePower_) {  // If VBUS is switched on
+            switchUSBPower(false, sequenceErrcnt_, sequenceErrstr_);  // Switch VBUS off
+            scheduleSequenceStep(SEQ_DETACH_POWER, timing_.shutdownDelay);  // Wait (100ms by default) to allow for device shutdown
+        } else {  // Already detached
+            finishSequence();
+        }
+    }
+}
+
+// Discards all events kept by the trace ring, and restarts the trace timestamps from zero
+void ITUSB1Device::clearTrace()
+{
+    cp2130_.clearTrace();
+}
+
+// Resets the transfer statistics
+void ITUSB1Device::clearTransferStats()
+{
+    cp2130_.clearTransferStats();
+}
+
 // Closes the device safely, if open
 void ITUSB1Device::close()
 {
+    int errcnt = 0;
+    std::string errstr;
+    stopSampler(errcnt, errstr);  // The sampler thread must be stopped before the device is closed
     cp2130_.close();
 }
 
+// Reports any errors that occurred during transfers submitted by readRawCurrentAsync(), whose events were handled via the shared context
+void ITUSB1Device::collectAsyncErrors(int &errcnt, std::string &errstr)
+{
+    cp2130_.collectAsyncErrors(errcnt, errstr);
+}
+
+// Disables the chip select of the LTC2312, after a series of readings performed via readRawCurrentAsync()
+void ITUSB1Device::deselectADC(int &errcnt, std::string &errstr)
+{
+    sleepFor(timing_.csDelay);  // Wait (100us by default), in order to prevent possible errors while disabling the chip select (workaround)
+    cp2130_.disableCS(0, errcnt, errstr);  // Disable the previously enabled chip select
+}
+
 // Detaches the DUT (device under test) to the HUT (host under test)
+// This function blocks until the sequence ends (see beginDetach() for a non-blocking alternative)
 void ITUSB1Device::detach(int &errcnt, std::string &errstr)
 {
-    if (getUSBDataStatus(errcnt, errstr)) {  // If the data lines are connected
-        switchUSBData(false, errcnt, errstr);  // Disconnect the data lines
-        usleep(100000);  // Wait 100ms in order to emulate a manual detachment of the device
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    beginDetach([&errcnt, &errstr](int seqErrcnt, const std::string &seqErrstr) {
+        errcnt += seqErrcnt;
+        errstr += seqErrstr;
+    }, errcnt, errstr);
+    while (advanceSequence()) {
+        std::chrono::steady_clock::time_point waitBegin = std::chrono::steady_clock::now();
+        std::this_thread::sleep_until(sequenceDeadline_);
+        cp2130_.addTraceEvent("sleep", "sequenceWait", waitBegin, std::chrono::steady_clock::now());
     }
-    if (getUSBPowerStatus(errcnt, errstr)) {  // If VBUS is switched on
-        switchUSBPower(false, errcnt, errstr);  // Switch VBUS off
-        usleep(100000);  // Wait 100ms to allow for device shutdown
+    cp2130_.addTraceEvent("operation", "detach", begin, std::chrono::steady_clock::now());
+}
+
+// Disables automatic reconnection (see enableAutoReconnect())
+void ITUSB1Device::disableAutoReconnect()
+{
+    autoReconnectSuspended_ = false;
+    cp2130_.disableAutoReconnect();
+}
+
+// Disables fail-fast mode (see enableFailFast())
+void ITUSB1Device::disableFailFast()
+{
+    cp2130_.disableFailFast();
+}
+
+// Disables tracing (the events recorded so far are kept)
+void ITUSB1Device::disableTracing()
+{
+    cp2130_.disableTracing();
+}
+
+// Moves every sample taken by the sampler so far to the end of the given vector, and returns the number of samples moved
+// This function does not take any locks, and it is meant to be called from a single consumer thread
+size_t ITUSB1Device::drainSamples(std::vector<Sample> &samples)
+{
+    size_t prevSize = samples.size();
+    samples.resize(prevSize + samples_.size());
+    size_t ndrained = samples_.pop(samples.data() + prevSize, samples.size() - prevSize);
+    samples.resize(prevSize + ndrained);
+    return ndrained;
+}
+
+// Enables automatic reconnection, so that functions reopen the device at the same USB port after a disconnect, restoring its configuration
+// Automatic reconnection is suspended while the sampler is running, since the device handle must not be replaced while it is used by the sampler thread
+void ITUSB1Device::enableAutoReconnect()
+{
+    if (samplerThread_.joinable()) {
+        autoReconnectSuspended_ = true;  // Automatic reconnection is enabled once the sampler stops
+    } else {
+        cp2130_.enableAutoReconnect();
     }
 }
 
+// Enables fail-fast mode, so that functions fail immediately, instead of waiting for transfer timeouts, once the device is known to be disconnected
+void ITUSB1Device::enableFailFast()
+{
+    cp2130_.enableFailFast();
+}
+
+// Enables tracing, using a trace ring able to hold the given number of events (see CP2130::enableTracing())
+void ITUSB1Device::enableTracing(size_t capacity)
+{
+    cp2130_.enableTracing(capacity);
+}
+
 // Returns the silicon version of the CP2130 bridge
 CP2130::SiliconVersion ITUSB1Device::getCP2130SiliconVersion(int &errcnt, std::string &errstr)
 {
@@ -98,18 +548,52 @@ CP2130::SiliconVersion ITUSB1Device::getCP2130SiliconVersion(int &errcnt, std::s
 // Important: SPI mode should be configured for channel 0, before using this function!
 float ITUSB1Device::getCurrent(int &errcnt, std::string &errstr)
 {
-    cp2130_.selectCS(0, errcnt, errstr);  // Enable the chip select corresponding to channel 0, and disable any others
-    usleep(100);  // Wait 100us, in order to prevent possible errors after enabling the chip select (workaround implemented in version 1.2.3)
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    selectADC(errcnt, errstr);  // This also disables the SPI delays, if they were last configured by getCurrentCoarse()
     getRawCurrent(errcnt, errstr);  // Discard this reading, as it will reflect a past measurement
     size_t currentCodeSum = 0;
     for (size_t i = 0; i < N_SAMPLES; ++i) {
         currentCodeSum += getRawCurrent(errcnt, errstr);  // Read the raw value (from the LTC2312 on channel 0) and add it to the sum
     }
-    usleep(100);  // Wait 100us, in order to prevent possible errors while disabling the chip select (workaround)
-    cp2130_.disableCS(0, errcnt, errstr);  // Disable the previously enabled chip select
+    deselectADC(errcnt, errstr);
+    cp2130_.addTraceEvent("operation", "getCurrent", begin, std::chrono::steady_clock::now());
     return currentCodeSum / (4.0 * N_SAMPLES);  // Return the average current out of "N_SAMPLES" [5] for each measurement (currentCode / 4.0 for a single reading)
 }
 
+// Gets a coarse reading of the VBUS current, using a single read command and thus a single USB round trip
+// The chip select is toggled between bytes, so that the second byte read corresponds to a fresh conversion, triggered after the first byte
+// Note that only the eight most significant bits of each conversion are read, so the resolution is limited to 4mA (16 codes of 0.25mA each)
+// An averaged reading at full resolution cannot be fetched with a single read command, and averaging several of these conversions would not recover the missing bits, since VBUS current is not dithered
+// Therefore, getCurrent() should be used whenever finer resolution is required
+// Important: SPI mode should be configured for channel 0, before using this function!
+float ITUSB1Device::getCurrentCoarse(int &errcnt, std::string &errstr)
+{
+    if (!burstDelays_) {  // The SPI delays are only configured once, and remain so until getCurrent() or setup() is called
+        CP2130::SPIDelays delays;
+        delays.cstglen = true;  // Toggle the chip select between bytes, so that each byte triggers a new conversion
+        delays.prdasten = false;  // Pre-deassert delay disabled
+        delays.pstasten = false;  // Post-assert delay disabled
+        delays.itbyten = true;  // Inter-byte delay enabled
+        delays.prdastdly = 0x0000;
+        delays.pstastdly = 0x0000;
+        delays.itbytdly = 0x0001;  // Inter-byte delay set to 10us, which is more than enough for the LTC2312 to complete each conversion
+        int preverrcnt = errcnt;
+        cp2130_.configureSPIDelays(0, delays, errcnt, errstr);  // Configure SPI delays for channel 0, using the above settings
+        burstDelays_ = errcnt == preverrcnt;
+    }
+    cp2130_.selectCS(0, errcnt, errstr);  // Enable the chip select corresponding to channel 0, and disable any others
+    sleepFor(timing_.csDelay);  // Wait (100us by default), in order to prevent possible errors after enabling the chip select (same workaround as in getCurrent())
+    uint8_t read[N_COARSE_BYTES];
+    size_t bytesRead = cp2130_.spiRead(read, N_COARSE_BYTES, EPIN, EPOUT, errcnt, errstr);
+    sleepFor(timing_.csDelay);  // Wait (100us by default), in order to prevent possible errors while disabling the chip select (workaround)
+    cp2130_.disableCS(0, errcnt, errstr);  // Disable the previously enabled chip select
+    uint16_t currentCode = 0;
+    if (bytesRead == N_COARSE_BYTES) {  // As in getRawCurrent(), it is important to check if the number of bytes read matches the number of expected bytes - If not, return zero!
+        currentCode = static_cast<uint16_t>(read[N_COARSE_BYTES - 1] << 4);  // Reconstruct the 12-bit code out of its eight most significant bits (the first byte is discarded)
+    }
+    return currentCode / 4.0;  // Return the current, truncated to a multiple of 4mA
+}
+
 // Returns the hardware revision of the device
 std::string ITUSB1Device::getHardwareRevision(int &errcnt, std::string &errstr)
 {
@@ -140,6 +624,22 @@ std::u16string ITUSB1Device::getSerialDesc(int &errcnt, std::string &errstr)
     return cp2130_.getSerialDesc(errcnt, errstr);
 }
 
+// Gets the status of VBUS, data lines and OC flag, along with the VBUS current, using the least possible number of USB transactions
+// The GPIO snapshot is taken right after the current measurement, so that all fields refer to the same instant, as much as possible
+// Important: SPI mode should be configured for channel 0, before using this function!
+ITUSB1Device::Status ITUSB1Device::getStatus(int &errcnt, std::string &errstr)
+{
+    Status status;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    status.current = getCurrent(errcnt, errstr);
+    CP2130::GPIOSnapshot gpios = cp2130_.getGPIOSnapshot(errcnt, errstr);  // A single control transfer is used to get all three flags
+    status.timestamp = start + (std::chrono::steady_clock::now() - start) / 2;
+    status.power = !gpios.gpio1();  // Negated !UPEN signal
+    status.data = !gpios.gpio2();  // Negated !UDEN signal
+    status.overcurrent = !gpios.gpio3();  // Negated !UDOC signal
+    return status;
+}
+
 // Gets the USB configuration of the device
 CP2130::USBConfig ITUSB1Device::getUSBConfig(int &errcnt, std::string &errstr)
 {
@@ -158,6 +658,39 @@ bool ITUSB1Device::getUSBPowerStatus(int &errcnt, std::string &errstr)
     return !cp2130_.getGPIO1(errcnt, errstr);  // Return the current state of the negated !UPEN signal
 }
 
+// Measures the power-on delay for the DUT currently connected to the device, and returns a timing profile containing it
+// The power-on delay is found by monitoring VBUS current, which must first rise and then settle
+// The remaining values are taken from the timing profile in use, which is left unchanged (use setTimingProfile() to apply the returned profile)
+// These cannot be measured reliably: chip select errors are intermittent, and VBUS current drops as soon as VBUS is switched off, well before the DUT shuts down
+// Note that the DUT is detached and power cycled during the measurement, and that the measured delay is rounded up to the time taken by each current measurement
+// Important: SPI mode should be configured for channel 0, before using this function!
+ITUSB1Device::TimingProfile ITUSB1Device::measureTiming(int &errcnt, std::string &errstr)
+{
+    TimingProfile measured = timing_;
+    detach(errcnt, errstr);  // Start from a known state
+    int preverrcnt = errcnt;
+    float offCurrent = getCurrent(errcnt, errstr);  // Current drawn with VBUS off, which is used as a reference
+    switchUSBPower(true, errcnt, errstr);  // Switch VBUS on (the data lines are kept disconnected, so that the DUT does not enumerate)
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    float prevCurrent = offCurrent;
+    bool risen = false, settled = false;
+    while (errcnt == preverrcnt && !settled && std::chrono::steady_clock::now() - start < std::chrono::microseconds(CAL_TIMEOUT)) {
+        float current = getCurrent(errcnt, errstr);
+        settled = risen && current - prevCurrent < CAL_SETTLE_TOLERANCE && prevCurrent - current < CAL_SETTLE_TOLERANCE;  // VBUS current is only considered settled after having risen, since it is also stable before the DUT starts drawing power
+        risen = risen || current - offCurrent >= CAL_RISE_THRESHOLD;
+        prevCurrent = current;
+    }
+    if (settled) {
+        measured.powerOnDelay = static_cast<unsigned int>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    } else if (errcnt == preverrcnt) {
+        ++errcnt;
+        errstr += risen ? "VBUS current did not settle after switching VBUS on.\n" : "VBUS current did not rise after switching VBUS on.\n";
+    }
+    switchUSBPower(false, errcnt, errstr);  // Switch VBUS off
+    sleepFor(timing_.shutdownDelay);  // Wait for the DUT to shut down, as configured in the timing profile in use
+    return measured;
+}
+
 // Opens a device and assigns its handle
 // The serial number is optional since version 1.2.0
 int ITUSB1Device::open(const std::string &serial)
@@ -165,15 +698,89 @@ int ITUSB1Device::open(const std::string &serial)
     return cp2130_.open(VID, PID, serial);
 }
 
+// Opens the device behind the given transport, such as a CP2130Simulator object (see CP2130::open())
+int ITUSB1Device::open(CP2130Transport &transport)
+{
+    return cp2130_.open(transport);
+}
+
+// Submits a raw current reading from the LTC2312 and returns immediately, so that readings from several devices can be submitted in the same instant
+// The given callback is called once the reading completes, from within the event handling of the context of the device (e.g., USBContext::handleEvents())
+// The callback is called if and only if no error is reported by this function, so that the caller can count pending readings reliably
+// As with getCurrent(), each reading reflects the conversion triggered at the end of the previous one
+// The IN transfer is submitted ahead of the read command, so that no reading is left behind in the CP2130 if submitting fails - If the command fails to be submitted, every transfer in flight is cancelled, since the pending IN transfer would otherwise take the data of a later reading, and the reading is abandoned
+// Important: selectADC() should be called beforehand, and deselectADC() afterwards!
+void ITUSB1Device::readRawCurrentAsync(const ReadingCallback &callback, int &errcnt, std::string &errstr)
+{
+    std::shared_ptr<AsyncReading> reading = std::make_shared<AsyncReading>();  // The buffers are kept alive by the completion callbacks
+    unsigned char readCommandBuffer[8] = {
+        0x00, 0x00,    // Reserved
+        CP2130::READ,  // Read command
+        0x00,          // Reserved
+        0x02,          // Two bytes per reading
+        0x00, 0x00, 0x00
+    };
+    std::copy(readCommandBuffer, readCommandBuffer + sizeof(readCommandBuffer), reading->command);
+    reading->abandoned = false;
+    int preverrcnt = errcnt;
+    cp2130_.bulkTransferAsync(EPIN, reading->data, static_cast<int>(sizeof(reading->data)), [reading, callback](int status, unsigned char *, int transferred) {
+        if (!reading->abandoned) {  // Otherwise, the error was already reported when submitting
+            std::chrono::steady_clock::time_point timestamp = std::chrono::steady_clock::now();
+            bool success = status == LIBUSB_TRANSFER_COMPLETED && transferred == static_cast<int>(sizeof(reading->data));  // As in getRawCurrent(), it is important to check if the number of bytes read matches the number of expected bytes
+            callback(success, success ? static_cast<uint16_t>(reading->data[0] << 4 | reading->data[1] >> 4) : 0, timestamp);
+        }
+    }, errcnt, errstr);
+    if (errcnt == preverrcnt) {
+        cp2130_.bulkTransferAsync(EPOUT, reading->command, static_cast<int>(sizeof(reading->command)), [reading](int, unsigned char *, int) {
+        }, errcnt, errstr);
+        if (errcnt != preverrcnt) {
+            reading->abandoned = true;  // The cancelled IN transfer is reaped later on, without calling the callback
+            cp2130_.cancelAsyncTransfers();
+        }
+    }
+}
+
+// Reopens the device at the same USB port, after a disconnect, restoring its configuration, and returns true if successful
+bool ITUSB1Device::reconnect(int &errcnt, std::string &errstr)
+{
+    return cp2130_.reconnect(errcnt, errstr);
+}
+
 // Issues a reset to the CP2130, which in effect resets the entire device
 void ITUSB1Device::reset(int &errcnt, std::string &errstr)
 {
     cp2130_.reset(errcnt, errstr);
 }
 
+// Enables the chip select of the LTC2312, so that readRawCurrentAsync() can be used
+// Important: SPI mode should be configured for channel 0, before using this function!
+void ITUSB1Device::selectADC(int &errcnt, std::string &errstr)
+{
+    if (burstDelays_) {  // If the SPI delays were last configured by getCurrentCoarse()
+        cp2130_.disableSPIDelays(0, errcnt, errstr);  // Disable all SPI delays for channel 0, so that the chip select stays asserted while each 2-byte sample is read
+        burstDelays_ = false;
+    }
+    cp2130_.selectCS(0, errcnt, errstr);  // Enable the chip select corresponding to channel 0, and disable any others
+    sleepFor(timing_.csDelay);  // Wait (100us by default), in order to prevent possible errors after enabling the chip select (workaround implemented in version 1.2.3)
+}
+
+// Sets the USB transfer timeouts (see CP2130::setTimeouts())
+void ITUSB1Device::setTimeouts(const CP2130::Timeouts &timeouts)
+{
+    cp2130_.setTimeouts(timeouts);
+}
+
+// Sets the timing profile used by the attach/detach sequences and the current measurements (TIMING_DEFAULT is used if none is set)
+// Important: the sampler should not be running, and no attach/detach sequence should be active, when calling this function!
+void ITUSB1Device::setTimingProfile(const TimingProfile &profile)
+{
+    timing_ = profile;
+}
+
 // Sets up and prepares the device
 void ITUSB1Device::setup(int &errcnt, std::string &errstr)
 {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
     CP2130::SPIMode mode;
     mode.csmode = CP2130::CSMODEPP;  // Chip select pin mode regarding channel 0 is push-pull
     mode.cfrq = CP2130::CFRQ1500K;  // SPI clock frequency set to 1.5MHz
@@ -181,10 +788,62 @@ void ITUSB1Device::setup(int &errcnt, std::string &errstr)
     mode.cpha = CP2130::CPHA0;  // SPI data is valid on each rising edge (CPHA = 0)
     cp2130_.configureSPIMode(0, mode, errcnt, errstr);  // Configure SPI mode for channel 0, using the above settings
     cp2130_.disableSPIDelays(0, errcnt, errstr);  // Disable all SPI delays for channel 0
+    burstDelays_ = false;
     cp2130_.selectCS(0, errcnt, errstr);  // Enable the chip select corresponding to channel 0, and disable any others
     getRawCurrent(errcnt, errstr);  // Discard this first reading - This also wakes up the LTC2312, if in nap or sleep mode!
-    usleep(1100);  // Wait 1.1ms to ensure that the LTC2312 is awake, and also to prevent possible errors while disabling the chip select (workaround)
+    sleepFor(timing_.wakeupDelay);  // Wait (1.1ms by default) to ensure that the LTC2312 is awake, and also to prevent possible errors while disabling the chip select (workaround)
     cp2130_.disableCS(0, errcnt, errstr);  // Disable the previously enabled chip select
+    cp2130_.addTraceEvent("operation", "setup", begin, std::chrono::steady_clock::now());
+}
+
+// Returns the time at which the current step of the attach/detach sequence ends, so that event loops know when to call advanceSequence() next
+std::chrono::steady_clock::time_point ITUSB1Device::sequenceDeadline() const
+{
+    return sequenceDeadline_;
+}
+
+// Starts the sampler, which reads the raw current from the LTC2312 on its own thread, at the given interval (in microseconds)
+// The samples are timestamped and stored in a lock-free ring buffer, from which they can be retrieved using drainSamples()
+// Important: SPI mode should be configured for channel 0, and no other functions that access the device should be called, until the sampler is stopped!
+// Automatic reconnection is suspended while the sampler is running (see enableAutoReconnect())
+void ITUSB1Device::startSampler(unsigned int interval, int &errcnt, std::string &errstr)
+{
+    if (!isOpen()) {
+        ++errcnt;
+        errstr += "In startSampler(): device is not open.\n";  // Program logic error
+    } else if (samplerThread_.joinable()) {
+        ++errcnt;
+        errstr += "In startSampler(): sampler is already running.\n";  // Program logic error
+    } else {
+        if (burstDelays_) {  // As in getCurrent(), the SPI delays last configured by getCurrentCoarse() must be disabled
+            cp2130_.disableSPIDelays(0, errcnt, errstr);
+            burstDelays_ = false;
+        }
+        autoReconnectSuspended_ = cp2130_.isAutoReconnectEnabled();  // See enableAutoReconnect()
+        cp2130_.disableAutoReconnect();
+        samplerStop_.store(false, std::memory_order_release);
+        samplerActive_.store(true, std::memory_order_release);
+        samplerThread_ = std::thread(&ITUSB1Device::runSampler, this, interval);
+    }
+}
+
+// Stops the sampler, if running, and reports any errors that occurred on the sampler thread
+// Note that any samples not yet drained are kept, and can still be retrieved using drainSamples()
+// Automatic reconnection, if it was suspended while the sampler was running, is enabled again
+void ITUSB1Device::stopSampler(int &errcnt, std::string &errstr)
+{
+    if (samplerThread_.joinable()) {
+        samplerStop_.store(true, std::memory_order_release);
+        samplerThread_.join();
+        errcnt += samplerErrcnt_;
+        errstr += samplerErrstr_;
+        samplerErrcnt_ = 0;
+        samplerErrstr_.clear();
+        if (autoReconnectSuspended_) {
+            autoReconnectSuspended_ = false;
+            cp2130_.enableAutoReconnect();
+        }
+    }
 }
 
 // Switches both VBUS and the data lines on or off
@@ -205,6 +864,38 @@ void ITUSB1Device::switchUSBPower(bool value, int &errcnt, std::string &errstr)
     cp2130_.setGPIO1(!value, errcnt, errstr);  // GPIO.1 corresponds to the !UPEN signal
 }
 
+// Helper function to enumerate devices, returning a record for each one
+std::vector<ITUSB1Device::DeviceInfo> ITUSB1Device::enumerateDevices(bool parallel, int &errcnt, std::string &errstr)
+{
+    std::vector<DeviceInfo> devices;
+    USBContext context;  // Initialize libusb (libusb is deinitialized as soon as the context goes out of scope)
+    if (context.isNull()) {  // In case of failure
+        ++errcnt;
+        errstr += "Could not initialize libusb.\n";
+    } else {  // If libusb is initialized
+        devices = enumerateDevices(context, parallel, errcnt, errstr);
+    }
+    return devices;
+}
+
+// Helper function to enumerate devices, using the device list cached by the given context
+// Each device is opened only once, and it is not claimed, so that this function can be used to take an inventory before opening any devices
+// If "parallel" is true, the devices are queried concurrently, using one thread per device
+std::vector<ITUSB1Device::DeviceInfo> ITUSB1Device::enumerateDevices(const USBContext &context, bool parallel, int &errcnt, std::string &errstr)
+{
+    std::vector<CP2130::DeviceInfo> cp2130Devices = CP2130::enumerateDevices(context, VID, PID, parallel, errcnt, errstr);
+    std::vector<DeviceInfo> devices(cp2130Devices.size());
+    for (size_t i = 0; i < cp2130Devices.size(); ++i) {
+        devices[i].serial = cp2130Devices[i].serial;
+        devices[i].bus = cp2130Devices[i].bus;
+        devices[i].ports = cp2130Devices[i].ports;
+        devices[i].address = cp2130Devices[i].address;
+        devices[i].hardwareRevision = hardwareRevision(cp2130Devices[i].config);
+        devices[i].silicon = cp2130Devices[i].silicon;
+    }
+    return devices;
+}
+
 // Helper function that returns the hardware revision from a given USB configuration
 std::string ITUSB1Device::hardwareRevision(const CP2130::USBConfig &config)
 {
@@ -225,3 +916,31 @@ std::list<std::string> ITUSB1Device::listDevices(int &errcnt, std::string &errst
 {
     return CP2130::listDevices(VID, PID, errcnt, errstr);
 }
+
+// Helper function to list devices, using the device list cached by the given context
+std::list<std::string> ITUSB1Device::listDevices(const USBContext &context, int &errcnt, std::string &errstr)
+{
+    return CP2130::listDevices(context, VID, PID, errcnt, errstr);
+}
+
+// Helper function that drives the attach/detach sequences of the given devices from a single thread, until all of them end
+// The sequences should be started beforehand, using beginAttach() or beginDetach() on each device
+void ITUSB1Device::runSequences(const std::vector<ITUSB1Device *> &devices)
+{
+    bool active = true;
+    while (active) {
+        active = false;
+        std::chrono::steady_clock::time_point wakeup = std::chrono::steady_clock::time_point::max();
+        for (size_t i = 0; i < devices.size(); ++i) {
+            if (devices[i]->advanceSequence()) {
+                active = true;
+                if (devices[i]->sequenceDeadline() < wakeup) {
+                    wakeup = devices[i]->sequenceDeadline();
+                }
+            }
+        }
+        if (active) {
+            std::this_thread::sleep_until(wakeup);  // Sleep until the earliest deadline, so that every step is taken on time
+        }
+    }
+}
@@ -1,6 +1,6 @@
-/* ITUSB1 device class - Version 1.2.3
-   Requires CP2130 class version 1.1.0 or later
-   Copyright (c) 2021-2022 Samuel Lourenço
+/* ITUSB1 device class - Version 1.3.0
+   Requires CP2130 class version 1.3.0 or later
+   Copyright (c) 2021-2026 Samuel Lourenço
 
    This library is free software: you can redistribute it and/or modify it
    under the terms of the GNU Lesser General Public License as published by
@@ -23,17 +23,44 @@
 #define ITUSB1DEVICE_H
 
 // Includes
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <list>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 #include "cp2130.h"
+#include "ringbuffer.h"
 
 class ITUSB1Device
 {
 private:
-    CP2130 cp2130_;
+    struct AsyncReading;
+    struct EnumerationWait;
 
+    CP2130 cp2130_;
+    bool burstDelays_, autoReconnectSuspended_;
+    std::thread samplerThread_;
+    std::atomic<bool> samplerActive_, samplerStop_;
+    std::atomic<size_t> droppedSamples_;
+    int samplerErrcnt_;
+    std::string samplerErrstr_;
+    int sequenceStep_;
+    bool sequencePower_;
+    std::chrono::steady_clock::time_point sequenceDeadline_;
+    int sequenceErrcnt_;
+    std::string sequenceErrstr_;
+
+    void finishSequence();
     uint16_t getRawCurrent(int &errcnt, std::string &errstr);
+    void runSampler(unsigned int interval);
+    void scheduleSequenceStep(int step, unsigned int delay);
+    void sleepFor(unsigned int delay);
+
+    static int LIBUSB_CALL enumerationCallback(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *userData);
 
 public:
     // Class definitions
@@ -43,34 +70,127 @@ public:
     static const int ERROR_INIT = CP2130::ERROR_INIT;            // Returned by open() in case of a libusb initialization failure
     static const int ERROR_NOT_FOUND = CP2130::ERROR_NOT_FOUND;  // Returned by open() if the device was not found
     static const int ERROR_BUSY = CP2130::ERROR_BUSY;            // Returned by open() if the device is already in use
+    static const size_t SAMPLER_BUFFER_SIZE = 4096;              // Number of samples that the sampler is able to hold, before older samples need to be drained
+    static const int ANY_ID = LIBUSB_HOTPLUG_MATCH_ANY;          // Can be passed to attachAndWait() instead of a VID or PID, in order to match any DUT
+
+    struct Sample {
+        uint16_t code;                                    // Raw LTC2312 code (the current in mA corresponds to code / 4.0)
+        std::chrono::steady_clock::time_point timestamp;  // Time at which the conversion was triggered
+    };
+
+    struct Status {
+        bool power;                                       // VBUS status (true if switched on)
+        bool data;                                        // Data lines status (true if connected)
+        bool overcurrent;                                 // OC flag
+        float current;                                    // VBUS current in mA
+        std::chrono::steady_clock::time_point timestamp;  // Time at which the status was taken (midpoint of the measurement)
+    };
+
+    struct TimingProfile {
+        unsigned int powerOnDelay;      // Delay after switching VBUS on, before connecting the data lines (in microseconds)
+        unsigned int enumerationDelay;  // Delay after connecting the data lines, so that device enumeration can start (in microseconds)
+        unsigned int dataOffDelay;      // Delay after disconnecting the data lines, before switching VBUS off (in microseconds)
+        unsigned int shutdownDelay;     // Delay after switching VBUS off, to allow for device shutdown (in microseconds)
+        unsigned int csDelay;           // Delay after enabling and before disabling the chip select, while reading the LTC2312 (in microseconds)
+        unsigned int wakeupDelay;       // Delay after waking up the LTC2312 (in microseconds)
+
+        bool operator ==(const TimingProfile &other) const;
+        bool operator !=(const TimingProfile &other) const;
+    };
+
+    static const TimingProfile TIMING_DEFAULT;  // Timing profile used by default, which is suitable for any DUT
+    static const TimingProfile TIMING_FAST;     // Faster timing profile, for DUTs that tolerate shorter power sequences
+
+    struct DeviceInfo {
+        std::string serial;              // Serial number
+        uint8_t bus;                     // Bus number
+        std::vector<uint8_t> ports;      // Port path, from the root hub down to the device
+        uint8_t address;                 // Device address
+        std::string hardwareRevision;    // Hardware revision (as returned by getHardwareRevision())
+        CP2130::SiliconVersion silicon;  // Silicon version of the CP2130 bridge
+
+        bool operator ==(const DeviceInfo &other) const;
+        bool operator !=(const DeviceInfo &other) const;
+    };
+
+    typedef std::function<void(bool success, uint16_t code, std::chrono::steady_clock::time_point timestamp)> ReadingCallback;  // Callback used by readRawCurrentAsync(), which receives the raw LTC2312 code and the time at which the reading completed
+    typedef std::function<void(int errcnt, const std::string &errstr)> SequenceCallback;  // Completion callback used by beginAttach() and beginDetach(), which receives the errors that occurred during the sequence
 
     ITUSB1Device();
+    explicit ITUSB1Device(const USBContext &context);
+    ~ITUSB1Device();
 
     bool disconnected() const;
+    size_t droppedSamples() const;
     bool isOpen() const;
-
+    bool isSamplerRunning() const;
+    bool isSequenceActive() const;
+    bool isTracingEnabled() const;
+    size_t lostTraceEvents() const;
+    CP2130::Timeouts timeouts() const;
+    std::chrono::steady_clock::time_point sequenceDeadline() const;
+    TimingProfile timingProfile() const;
+    std::string traceJSON() const;
+    std::vector<CP2130::TransferStats> transferStats() const;
+
+    bool advanceSequence();
     void attach(int &errcnt, std::string &errstr);
+    std::chrono::microseconds attachAndWait(int vid, int pid, unsigned int timeout, int &errcnt, std::string &errstr);
+    void beginAttach(const SequenceCallback &callback, int &errcnt, std::string &errstr);
+    void beginDetach(const SequenceCallback &callback, int &errcnt, std::string &errstr);
+    void clearTrace();
+    void clearTransferStats();
     void close();
+    void collectAsyncErrors(int &errcnt, std::string &errstr);
+    void deselectADC(int &errcnt, std::string &errstr);
     void detach(int &errcnt, std::string &errstr);
+    void disableAutoReconnect();
+    void disableFailFast();
+    void disableTracing();
+    size_t drainSamples(std::vector<Sample> &samples);
+    void enableAutoReconnect();
+    void enableFailFast();
+    void enableTracing(size_t capacity = CP2130::TRACE_BUFFER_SIZE);
     CP2130::SiliconVersion getCP2130SiliconVersion(int &errcnt, std::string &errstr);
     float getCurrent(int &errcnt, std::string &errstr);
+    float getCurrentCoarse(int &errcnt, std::string &errstr);
     std::string getHardwareRevision(int &errcnt, std::string &errstr);
     std::u16string getManufacturerDesc(int &errcnt, std::string &errstr);
     bool getOvercurrentStatus(int &errcnt, std::string &errstr);
     std::u16string getProductDesc(int &errcnt, std::string &errstr);
     std::u16string getSerialDesc(int &errcnt, std::string &errstr);
+    Status getStatus(int &errcnt, std::string &errstr);
     CP2130::USBConfig getUSBConfig(int &errcnt, std::string &errstr);
     bool getUSBDataStatus(int &errcnt, std::string &errstr);
     bool getUSBPowerStatus(int &errcnt, std::string &errstr);
+    TimingProfile measureTiming(int &errcnt, std::string &errstr);
     int open(const std::string &serial = std::string());
+    int open(CP2130Transport &transport);
+    void readRawCurrentAsync(const ReadingCallback &callback, int &errcnt, std::string &errstr);
+    bool reconnect(int &errcnt, std::string &errstr);
     void reset(int &errcnt, std::string &errstr);
+    void selectADC(int &errcnt, std::string &errstr);
+    void setTimeouts(const CP2130::Timeouts &timeouts);
+    void setTimingProfile(const TimingProfile &profile);
     void setup(int &errcnt, std::string &errstr);
+    void startSampler(unsigned int interval, int &errcnt, std::string &errstr);
+    void stopSampler(int &errcnt, std::string &errstr);
     void switchUSB(bool value, int &errcnt, std::string &errstr);
     void switchUSBData(bool value, int &errcnt, std::string &errstr);
     void switchUSBPower(bool value, int &errcnt, std::string &errstr);
 
+    static std::vector<DeviceInfo> enumerateDevices(bool parallel, int &errcnt, std::string &errstr);
+    static std::vector<DeviceInfo> enumerateDevices(const USBContext &context, bool parallel, int &errcnt, std::string &errstr);
     static std::string hardwareRevision(const CP2130::USBConfig &config);
     static std::list<std::string> listDevices(int &errcnt, std::string &errstr);
+    static std::list<std::string> listDevices(const USBContext &context, int &errcnt, std::string &errstr);
+    static void runSequences(const std::vector<ITUSB1Device *> &devices);
+
+private:
+    // Sampler, sequencer and timing state (declared here, since it depends on the above types)
+    RingBuffer<Sample> samples_;
+    SequenceCallback sequenceCallback_;
+    TimingProfile timing_;
 };
 
 #endif  // ITUSB1DEVICE_H
@@ -0,0 +1,269 @@
+/* ITUSB1 fleet class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+
+// Includes
+#include <future>
+#include <list>
+#include "itusb1fleet.h"
+
+// Private function that runs the given operation on all devices concurrently, using one thread per device, and returns the respective results
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::dispatch(const std::function<void(ITUSB1Device &, Result &)> &operation)
+{
+    std::vector<Result> results = emptyResults();
+    std::vector<std::future<void>> futures;
+    futures.reserve(devices_.size());
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        futures.push_back(std::async(std::launch::async, [this, &operation, &results, i]() {
+            operation(*devices_[i], results[i]);  // Each thread only accesses its own device and result
+        }));
+    }
+    for (size_t i = 0; i < futures.size(); ++i) {
+        futures[i].get();
+    }
+    return results;
+}
+
+// Private function that returns one result per device, with all fields cleared except for the serial number
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::emptyResults() const
+{
+    std::vector<Result> results(devices_.size());
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        results[i].serial = serials_[i];
+        results[i].errcnt = 0;
+        results[i].current = 0;
+        results[i].sequence = 0;
+    }
+    return results;
+}
+
+// Private procedure that submits one raw current reading per device, all at once, and then handles events until every reading completes
+// Only devices without errors so far take part - If "keep" is true, the readings are stored in the results, otherwise only their completion times are
+void ITUSB1Fleet::readAll(std::vector<Result> &results, bool keep)
+{
+    struct Readings {
+        size_t pending;                                                // Number of readings that did not complete yet
+        std::vector<bool> success;                                     // Outcome of each reading
+        std::vector<uint16_t> codes;                                   // Raw LTC2312 codes
+        std::vector<std::chrono::steady_clock::time_point> completed;  // Completion time of each reading
+    };
+    std::shared_ptr<Readings> readings = std::make_shared<Readings>();  // Shared with the callbacks, so that late completions are harmless if event handling fails
+    readings->pending = 0;
+    readings->success.assign(devices_.size(), false);
+    readings->codes.assign(devices_.size(), 0);
+    readings->completed.resize(devices_.size());
+    for (size_t i = 0; i < devices_.size(); ++i) {  // All readings are submitted before any events are handled, so that they are dispatched in the same scheduling tick
+        if (results[i].errcnt == 0) {
+            int preverrcnt = results[i].errcnt;
+            devices_[i]->readRawCurrentAsync([readings, i](bool success, uint16_t code, std::chrono::steady_clock::time_point timestamp) {
+                --readings->pending;
+                readings->success[i] = success;
+                readings->codes[i] = code;
+                readings->completed[i] = timestamp;
+            }, results[i].errcnt, results[i].errstr);
+            if (results[i].errcnt == preverrcnt) {  // The callback is called if and only if no error was reported
+                ++readings->pending;
+            }
+        }
+    }
+    int errcnt = 0;
+    std::string errstr;
+    while (readings->pending > 0 && errcnt == 0) {  // Transfers always complete or time out, so this loop ends unless event handling itself fails
+        context_.handleEvents(errcnt, errstr);
+    }
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        if (results[i].errcnt == 0) {
+            results[i].errcnt += errcnt;
+            results[i].errstr += errstr;
+            devices_[i]->collectAsyncErrors(results[i].errcnt, results[i].errstr);
+            if (results[i].errcnt == 0 && !readings->success[i]) {
+                ++results[i].errcnt;
+                results[i].errstr += "Failed to read current.\n";
+            }
+            if (keep) {
+                results[i].current = readings->codes[i] / 4.0f;
+            } else {
+                results[i].timestamp = readings->completed[i];  // The conversion that is fetched by the next reading is triggered at the end of this one
+            }
+        }
+    }
+}
+
+// Private function that attaches or detaches all devices, driving their sequences from the calling thread, and returns the respective results
+// No additional threads are required here, since the sequences spend most of their time waiting
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::runSequences(bool attach)
+{
+    std::vector<Result> results = emptyResults();
+    std::vector<ITUSB1Device *> devices(devices_.size());
+    for (size_t i = 0; i < devices_.size(); ++i) {
+        devices[i] = devices_[i].get();
+        Result &result = results[i];
+        ITUSB1Device::SequenceCallback callback = [&result](int errcnt, const std::string &errstr) {
+            result.errcnt += errcnt;
+            result.errstr += errstr;
+        };
+        if (attach) {
+            devices[i]->beginAttach(callback, result.errcnt, result.errstr);
+        } else {
+            devices[i]->beginDetach(callback, result.errcnt, result.errstr);
+        }
+    }
+    ITUSB1Device::runSequences(devices);
+    return results;
+}
+
+// Constructs an empty fleet, initializing the context that is shared by all devices (see open())
+ITUSB1Fleet::ITUSB1Fleet() :
+    context_(),
+    devices_(),
+    serials_(),
+    sequence_(0)
+{
+}
+
+ITUSB1Fleet::~ITUSB1Fleet()
+{
+    close();
+}
+
+// Returns the context shared by all devices, so that it can be used to open other devices or to handle events
+USBContext ITUSB1Fleet::context() const
+{
+    return context_;
+}
+
+// Returns the number of open devices
+size_t ITUSB1Fleet::size() const
+{
+    return devices_.size();
+}
+
+// Attaches all DUTs to their respective HUTs
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::attachAll()
+{
+    return runSequences(true);
+}
+
+// Closes all devices
+void ITUSB1Fleet::close()
+{
+    devices_.clear();  // Each device is closed as it is destroyed
+    serials_.clear();
+}
+
+// Detaches all DUTs from their respective HUTs
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::detachAll()
+{
+    return runSequences(false);
+}
+
+// Returns the device at the given index, for operations that are not covered by this class
+ITUSB1Device &ITUSB1Fleet::device(size_t index)
+{
+    return *devices_[index];
+}
+
+// Discovers all ITUSB1 devices, then opens and sets up each one of them concurrently, and returns the respective results
+// Devices that fail to open are not kept, but their results are still returned - Any previously open devices are closed first
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::open(int &errcnt, std::string &errstr)
+{
+    close();
+    std::vector<Result> results;
+    if (context_.isNull()) {
+        ++errcnt;
+        errstr += "Could not initialize libusb.\n";
+    } else {
+        std::list<std::string> serials = ITUSB1Device::listDevices(context_, errcnt, errstr);
+        for (std::list<std::string>::const_iterator it = serials.begin(); it != serials.end(); ++it) {
+            devices_.push_back(std::unique_ptr<ITUSB1Device>(new ITUSB1Device(context_)));
+            serials_.push_back(*it);
+        }
+        results = dispatch([](ITUSB1Device &device, Result &result) {
+            int status = device.open(result.serial);
+            if (status == ITUSB1Device::SUCCESS) {
+                device.setup(result.errcnt, result.errstr);
+            } else {
+                ++result.errcnt;
+                if (status == ITUSB1Device::ERROR_NOT_FOUND) {
+                    result.errstr += "Could not find device.\n";
+                } else if (status == ITUSB1Device::ERROR_BUSY) {
+                    result.errstr += "Device is currently unavailable.\n";
+                } else {
+                    result.errstr += "Could not open device.\n";
+                }
+            }
+        });
+        size_t nkept = 0;
+        for (size_t i = 0; i < devices_.size(); ++i) {  // Remove the devices that failed to open, while preserving the order of the remaining ones
+            if (devices_[i]->isOpen()) {
+                devices_[nkept].swap(devices_[i]);
+                serials_[nkept].swap(serials_[i]);
+                ++nkept;
+            }
+        }
+        devices_.resize(nkept);
+        serials_.resize(nkept);
+    }
+    return results;
+}
+
+// Gets the VBUS current of all devices
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::sampleAll()
+{
+    return dispatch([](ITUSB1Device &device, Result &result) {
+        result.current = device.getCurrent(result.errcnt, result.errstr);
+    });
+}
+
+// Gets the VBUS current of all devices, with the readings of all devices being submitted in the same instant, so that the skew between them is minimized
+// Each result is tagged with a sequence number, common to all devices and incremented on every call, and with the time at which the respective conversion was triggered
+// Note that each device contributes a single reading, instead of the average taken by getCurrent()
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::sampleSync()
+{
+    uint64_t sequence = ++sequence_;
+    std::vector<Result> results = dispatch([](ITUSB1Device &device, Result &result) {
+        device.selectADC(result.errcnt, result.errstr);  // The chip selects are enabled concurrently, since this involves control transfers
+    });
+    readAll(results, false);  // The first round of readings triggers the conversions, and their completion times become the timestamps of the samples
+    readAll(results, true);  // The second round fetches those conversions
+    std::vector<Result> deselected = dispatch([](ITUSB1Device &device, Result &result) {
+        device.deselectADC(result.errcnt, result.errstr);
+    });
+    for (size_t i = 0; i < results.size(); ++i) {
+        results[i].errcnt += deselected[i].errcnt;
+        results[i].errstr += deselected[i].errstr;
+        results[i].sequence = sequence;
+    }
+    return results;
+}
+
+// Returns the serial number of the device at the given index
+std::string ITUSB1Fleet::serial(size_t index) const
+{
+    return serials_[index];
+}
+
+// Switches VBUS and connects the data lines of all devices (or the reverse, if the given value is false)
+std::vector<ITUSB1Fleet::Result> ITUSB1Fleet::switchAll(bool value)
+{
+    return dispatch([value](ITUSB1Device &device, Result &result) {
+        device.switchUSB(value, result.errcnt, result.errstr);
+    });
+}
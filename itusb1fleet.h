@@ -0,0 +1,79 @@
+/* ITUSB1 fleet class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+
+#ifndef ITUSB1FLEET_H
+#define ITUSB1FLEET_H
+
+// Includes
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "itusb1device.h"
+#include "usbcontext.h"
+
+// Manages all ITUSB1 devices connected to the host, which are held in a single shared context
+// Operations are dispatched to all devices concurrently, and their outcome is reported per device
+class ITUSB1Fleet
+{
+public:
+    struct Result {
+        std::string serial;  // Serial number of the device
+        int errcnt;          // Number of errors that occurred while operating on the device
+        std::string errstr;  // Error messages, in the same format as those returned by ITUSB1Device functions
+        float current;       // VBUS current in mA (only applicable to sampleAll() and sampleSync())
+        uint64_t sequence;   // Sequence number, common to all samples taken by the same call (only applicable to sampleSync())
+        std::chrono::steady_clock::time_point timestamp;  // Time at which the conversion was triggered (only applicable to sampleSync())
+    };
+
+private:
+    USBContext context_;
+    std::vector<std::unique_ptr<ITUSB1Device>> devices_;
+    std::vector<std::string> serials_;
+    uint64_t sequence_;
+
+    std::vector<Result> dispatch(const std::function<void(ITUSB1Device &, Result &)> &operation);
+    std::vector<Result> emptyResults() const;
+    void readAll(std::vector<Result> &results, bool keep);
+    std::vector<Result> runSequences(bool attach);
+
+public:
+    ITUSB1Fleet();
+    ~ITUSB1Fleet();
+
+    USBContext context() const;
+    size_t size() const;
+
+    std::vector<Result> attachAll();
+    void close();
+    std::vector<Result> detachAll();
+    ITUSB1Device &device(size_t index);
+    std::vector<Result> open(int &errcnt, std::string &errstr);
+    std::vector<Result> sampleAll();
+    std::vector<Result> sampleSync();
+    std::string serial(size_t index) const;
+    std::vector<Result> switchAll(bool value);
+};
+
+#endif  // ITUSB1FLEET_H
@@ -0,0 +1,134 @@
+/* Ring buffer class template - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+// Includes
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free ring buffer, meant to be used by a single producer thread and a single consumer thread
+// Only the producer may call push(), and only the consumer may call pop() - All other functions may be called from any thread
+template <typename T>
+class RingBuffer
+{
+private:
+    std::vector<T> buffer_;
+    size_t mask_;
+    char padding0_[64];         // Padding is used instead of alignas(64), so that objects holding a ring buffer can still be allocated with operator new in C++11
+    std::atomic<size_t> head_;  // Count of elements ever written (only modified by the producer)
+    char padding1_[64];         // Keeps head_ and tail_ in separate cache lines
+    std::atomic<size_t> tail_;  // Count of elements ever read (only modified by the consumer)
+    char padding2_[64];         // Keeps tail_ apart from any adjacent data
+
+    static size_t roundCapacity(size_t capacity);
+
+public:
+    explicit RingBuffer(size_t capacity);
+
+    size_t capacity() const;
+    bool empty() const;
+    size_t size() const;
+
+    size_t pop(T *elements, size_t count);
+    bool push(const T &element);
+};
+
+// Private helper function that rounds the given capacity up to a power of two, so that indexes can be wrapped using a mask
+template <typename T>
+size_t RingBuffer<T>::roundCapacity(size_t capacity)
+{
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+// Constructs a ring buffer that is able to hold at least the given number of elements (the capacity is rounded up to a power of two)
+template <typename T>
+RingBuffer<T>::RingBuffer(size_t capacity) :
+    buffer_(roundCapacity(capacity)),
+    mask_(buffer_.size() - 1),
+    padding0_(),
+    head_(0),
+    padding1_(),
+    tail_(0),
+    padding2_()
+{
+}
+
+// Returns the number of elements that the ring buffer is able to hold
+template <typename T>
+size_t RingBuffer<T>::capacity() const
+{
+    return buffer_.size();
+}
+
+// Checks if the ring buffer is empty
+template <typename T>
+bool RingBuffer<T>::empty() const
+{
+    return size() == 0;
+}
+
+// Returns the number of elements currently held (this is only a snapshot, if the other thread is active)
+// The tail is loaded before the head, so that the result never wraps around, even if called from a third thread - Since the head may then be newer than the tail, the result is limited to the capacity
+template <typename T>
+size_t RingBuffer<T>::size() const
+{
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t count = head_.load(std::memory_order_acquire) - tail;
+    return count < buffer_.size() ? count : buffer_.size();
+}
+
+// Removes up to the given number of elements, copying them to the given array, and returns the number of elements removed (consumer only)
+template <typename T>
+size_t RingBuffer<T>::pop(T *elements, size_t count)
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t available = head_.load(std::memory_order_acquire) - tail;  // The acquire operation guarantees that the elements written by the producer are visible
+    size_t npop = count < available ? count : available;
+    for (size_t i = 0; i < npop; ++i) {
+        elements[i] = buffer_[(tail + i) & mask_];
+    }
+    tail_.store(tail + npop, std::memory_order_release);  // Hand the freed slots back to the producer
+    return npop;
+}
+
+// Adds an element, and returns true if successful, or false if the ring buffer is full (producer only)
+template <typename T>
+bool RingBuffer<T>::push(const T &element)
+{
+    bool pushed;
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == buffer_.size()) {  // If the ring buffer is full
+        pushed = false;
+    } else {
+        buffer_[head & mask_] = element;
+        head_.store(head + 1, std::memory_order_release);  // Publish the element to the consumer
+        pushed = true;
+    }
+    return pushed;
+}
+
+#endif  // RINGBUFFER_H
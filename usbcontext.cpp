@@ -0,0 +1,413 @@
+/* USB context class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+// Includes
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include "usbcontext.h"
+
+// Definitions
+const unsigned int EV_TIMEOUT = 500;  // Event handling timeout in milliseconds
+
+// Private structure that holds the state shared by all copies of a USBContext object
+struct USBContext::Shared {
+    typedef std::vector<uint8_t> Location;            // Bus number followed by the port path, which identifies where a device is connected
+    typedef std::pair<uint32_t, std::string> Serial;  // VID and PID (packed into a single value) followed by the serial number, which identifies a device
+
+    libusb_context *context;               // libusb context (null if libusb failed to initialize)
+    std::mutex mutex;                      // Protects the cached device list and the serial index, so that the same context can be used from several threads
+    std::vector<libusb_device *> devices;  // Cached device list (each listed device is referenced)
+    bool enumerated;                       // Flag that indicates that the device list was already retrieved
+    bool hotplug;                          // Flag that indicates that hotplug events are used to keep both the device list and the serial index up to date
+    libusb_hotplug_callback_handle hotplugHandle;
+    std::map<Location, Serial> serials;    // Serial index, containing the serial number of each device that was already opened once
+    std::map<Serial, Location> locations;  // Reverse serial index, used to look up devices by serial number
+
+    Shared();
+    ~Shared();
+
+    void enumerate(int &errcnt, std::string &errstr);
+    void resolve(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr);
+    void unindex(const Location &loc);
+
+    static int LIBUSB_CALL hotplugCallback(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *userData);
+    static Location location(libusb_device *device);
+    static bool readSerial(libusb_device_handle *handle, uint8_t index, std::string &serial);
+    static uint32_t vidPid(uint16_t vid, uint16_t pid);
+};
+
+// Constructor for the shared state, which initializes libusb
+USBContext::Shared::Shared() :
+    context(nullptr),
+    mutex(),
+    devices(),
+    enumerated(false),
+    hotplug(false),
+    hotplugHandle(),
+    serials(),
+    locations()
+{
+    if (libusb_init(&context) != 0) {  // Initialize libusb. In case of failure
+        context = nullptr;  // Required to mark the context as null
+    } else if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) != 0) {  // If hotplug events are supported, they are used to invalidate the cached device list and to prune the serial index
+        hotplug = libusb_hotplug_register_callback(context, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, LIBUSB_HOTPLUG_NO_FLAGS, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, hotplugCallback, this, &hotplugHandle) == 0;
+    }
+}
+
+// Destructor for the shared state, which is called when the last copy of the USBContext object is destroyed
+USBContext::Shared::~Shared()
+{
+    freeDevices(devices);
+    if (context != nullptr) {
+        if (hotplug) {
+            libusb_hotplug_deregister_callback(context, hotplugHandle);
+        }
+        libusb_exit(context);  // Deinitialize libusb
+    }
+}
+
+// Retrieves and caches the device list, replacing any previously cached one (the mutex must be locked by the caller)
+// Indexed locations whose device changed since the previous enumeration are dropped from the serial index, since hotplug events are only delivered while events are handled
+void USBContext::Shared::enumerate(int &errcnt, std::string &errstr)
+{
+    std::vector<libusb_device *> previous;
+    previous.swap(devices);  // The previous device list is only freed at the end, so that its devices remain referenced and can be compared with the new ones
+    enumerated = false;
+    libusb_device **devs;
+    ssize_t devlist = libusb_get_device_list(context, &devs);  // Get a device list
+    if (devlist < 0) {  // If the previous operation fails to get a device list
+        ++errcnt;
+        errstr += "Failed to retrieve a list of devices.\n";
+    } else {
+        devices.assign(devs, devs + devlist);
+        libusb_free_device_list(devs, 0);  // Free device list, but keep the devices referenced, since they are now cached
+        enumerated = true;
+    }
+    if (!hotplug) {  // Without hotplug events, there is no way to tell if a device was replaced by another at the same location, so the serial index is rebuilt
+        serials.clear();
+        locations.clear();
+    } else {
+        std::set<Location> unchanged;  // Locations of the devices that are listed both times (libusb keeps the same device object for as long as a device remains connected)
+        for (size_t i = 0; i < devices.size(); ++i) {
+            if (std::find(previous.begin(), previous.end(), devices[i]) != previous.end()) {
+                unchanged.insert(location(devices[i]));
+            }
+        }
+        std::map<Location, Serial>::iterator it = serials.begin();
+        while (it != serials.end()) {
+            if (unchanged.count(it->first) == 0) {  // Either the device was disconnected, or another device took its location
+                locations.erase(it->second);
+                it = serials.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    freeDevices(previous);
+}
+
+// Adds the devices having the given VID and PID to the serial index, if not indexed yet (the mutex must not be locked by the caller)
+// Each of these devices is opened once, in order to read its serial number, but devices that are already indexed are not opened again
+// The mutex is only locked while the cached device list and the serial index are accessed, so that the hotplug callback is never kept waiting while devices are opened
+void USBContext::Shared::resolve(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr)
+{
+    std::vector<libusb_device *> pending;  // Devices that are not indexed yet (each is referenced, so that it remains valid after the mutex is unlocked)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enumerated) {
+            enumerate(errcnt, errstr);
+        }
+        for (size_t i = 0; i < devices.size(); ++i) {  // Run through all cached devices
+            libusb_device_descriptor desc;
+            if (libusb_get_device_descriptor(devices[i], &desc) == 0 && desc.idVendor == vid && desc.idProduct == pid && serials.count(location(devices[i])) == 0) {  // If the device descriptor is retrieved, both VID and PID correspond to the respective given values, and the device is not indexed yet
+                pending.push_back(libusb_ref_device(devices[i]));
+            }
+        }
+    }
+    for (size_t i = 0; i < pending.size(); ++i) {
+        libusb_device_descriptor desc;
+        libusb_device_handle *handle;
+        if (libusb_get_device_descriptor(pending[i], &desc) == 0 && libusb_open(pending[i], &handle) == 0) {  // If the device is opened successfully
+            std::string serial;
+            bool serialRead = readSerial(handle, desc.iSerialNumber, serial);
+            libusb_close(handle);  // Close the device
+            if (serialRead) {
+                Location loc = location(pending[i]);
+                Serial key(vidPid(vid, pid), serial);
+                std::lock_guard<std::mutex> lock(mutex);
+                serials[loc] = key;
+                locations[key] = loc;
+            }
+        }
+    }
+    freeDevices(pending);
+}
+
+// Removes the device at the given location from the serial index, if indexed (the mutex must be locked by the caller)
+void USBContext::Shared::unindex(const Location &loc)
+{
+    std::map<Location, Serial>::iterator it = serials.find(loc);
+    if (it != serials.end()) {
+        locations.erase(it->second);
+        serials.erase(it);
+    }
+}
+
+// Static function that is called by libusb whenever a device arrives or leaves, from within event handling (e.g., handleEvents())
+// No devices can be opened here, so arriving devices are only indexed when they are first looked up - Devices that leave are removed from the serial index at once
+int LIBUSB_CALL USBContext::Shared::hotplugCallback(libusb_context *, libusb_device *device, libusb_hotplug_event event, void *userData)
+{
+    Shared *shared = static_cast<Shared *>(userData);
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    shared->enumerated = false;  // The cached device list is retrieved again on next use
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+        shared->unindex(location(device));
+    }
+    return 0;  // Keep the callback registered
+}
+
+// Returns the location of the given device, consisting of its bus number followed by its port path
+USBContext::Shared::Location USBContext::Shared::location(libusb_device *device)
+{
+    uint8_t ports[MAX_PORT_DEPTH];
+    int nports = libusb_get_port_numbers(device, ports, MAX_PORT_DEPTH);
+    Location loc;
+    loc.reserve(MAX_PORT_DEPTH + 1);  // Reserving the maximum size first avoids a reallocation while inserting the port path
+    loc.push_back(libusb_get_bus_number(device));
+    if (nports > 0) {
+        loc.insert(loc.end(), ports, ports + nports);
+    }
+    return loc;
+}
+
+// Reads the serial number of the given open device, using the given string descriptor index, and returns true if successful
+bool USBContext::Shared::readSerial(libusb_device_handle *handle, uint8_t index, std::string &serial)
+{
+    unsigned char str_desc[256];
+    bool retval = libusb_get_string_descriptor_ascii(handle, index, str_desc, static_cast<int>(sizeof(str_desc))) >= 0;  // Get the serial number string in ASCII format
+    if (retval) {
+        serial = reinterpret_cast<char *>(str_desc);
+    }
+    return retval;
+}
+
+// Packs the given VID and PID into a single value, as used by the serial index
+uint32_t USBContext::Shared::vidPid(uint16_t vid, uint16_t pid)
+{
+    return static_cast<uint32_t>(vid) << 16 | pid;
+}
+
+// Creates a new context, initializing libusb
+// The initialization may fail, in which case the context is null (see isNull())
+USBContext::USBContext() :
+    shared_(std::make_shared<Shared>())
+{
+    if (shared_->context == nullptr) {
+        shared_.reset();
+    }
+}
+
+// Creates a null context, which does not refer to any libusb context
+USBContext::USBContext(std::nullptr_t) :
+    shared_()
+{
+}
+
+// Returns the underlying libusb context (or a null pointer if the context is null)
+libusb_context *USBContext::get() const
+{
+    return shared_ ? shared_->context : nullptr;
+}
+
+// Returns the devices having the given VID and PID, out of the cached device list (the list is retrieved on first use, or after a refresh)
+// Each returned device is referenced, and the vector should be passed to freeDevices() when no longer needed
+std::vector<libusb_device *> USBContext::getDevices(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr) const
+{
+    std::vector<libusb_device *> devices;
+    if (isNull()) {
+        ++errcnt;
+        errstr += "In getDevices(): context is null.\n";  // Program logic error
+    } else {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        if (!shared_->enumerated) {
+            shared_->enumerate(errcnt, errstr);
+        }
+        for (size_t i = 0; i < shared_->devices.size(); ++i) {  // Run through all cached devices
+            libusb_device_descriptor desc;
+            if (libusb_get_device_descriptor(shared_->devices[i], &desc) == 0 && desc.idVendor == vid && desc.idProduct == pid) {  // If the device descriptor is retrieved, and both VID and PID correspond to the respective given values
+                devices.push_back(libusb_ref_device(shared_->devices[i]));
+            }
+        }
+    }
+    return devices;
+}
+
+// Returns the serial numbers of the devices having the given VID and PID
+// Devices are looked up in the serial index, so that only those that were not indexed yet are opened
+std::list<std::string> USBContext::getSerials(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr) const
+{
+    std::list<std::string> serials;
+    if (isNull()) {
+        ++errcnt;
+        errstr += "In getSerials(): context is null.\n";  // Program logic error
+    } else {
+        shared_->resolve(vid, pid, errcnt, errstr);
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        for (size_t i = 0; i < shared_->devices.size(); ++i) {  // The cached device list is used, so that the serial numbers are returned in enumeration order
+            std::map<Shared::Location, Shared::Serial>::const_iterator it = shared_->serials.find(Shared::location(shared_->devices[i]));
+            if (it != shared_->serials.end() && it->second.first == Shared::vidPid(vid, pid)) {
+                serials.push_back(it->second.second);
+            }
+        }
+    }
+    return serials;
+}
+
+// Handles pending USB events for every device open within this context, so that a single event loop can serve all of them
+// This function blocks until at least one event is handled, or until the timeout expires
+// Important: it should be called from a single thread, since the transfer callbacks of the objects using this context are not guarded against concurrent calls!
+void USBContext::handleEvents(int &errcnt, std::string &errstr) const
+{
+    if (isNull()) {
+        ++errcnt;
+        errstr += "In handleEvents(): context is null.\n";  // Program logic error
+    } else {
+        timeval timeout = {EV_TIMEOUT / 1000, 1000 * (EV_TIMEOUT % 1000)};
+        if (libusb_handle_events_timeout_completed(shared_->context, &timeout, nullptr) != 0) {
+            ++errcnt;
+            errstr += "Failed to handle USB events.\n";
+        }
+    }
+}
+
+// Returns true if the context is null, either because it was created as such or because libusb failed to initialize
+bool USBContext::isNull() const
+{
+    return !shared_;
+}
+
+// Opens the device having the given VID, PID and, optionally, the given serial number, and returns its handle (or a null pointer if no device was found)
+// The cached device list is used, and it is refreshed once if no matching device is found, in order to account for devices connected in the meantime
+// If a serial number is given, the device is looked up in the serial index, so that no other devices need to be opened (except those not indexed yet)
+// In that case, the serial number is read back after opening, since another device may have taken the indexed location in the meantime - If so, the stale index entry is dropped
+libusb_device_handle *USBContext::openDevice(uint16_t vid, uint16_t pid, const std::string &serial) const
+{
+    libusb_device_handle *handle = nullptr;
+    for (int attempt = 0; attempt < 2 && handle == nullptr && !isNull(); ++attempt) {
+        int errcnt = 0;  // Errors are not reported here, since a null handle is returned anyway
+        std::string errstr;
+        if (attempt > 0) {
+            refresh(errcnt, errstr);
+        }
+        if (serial.empty()) {  // The first device found with matching VID and PID is used
+            std::vector<libusb_device *> devices = getDevices(vid, pid, errcnt, errstr);
+            for (size_t i = 0; i < devices.size() && handle == nullptr; ++i) {
+                if (libusb_open(devices[i], &handle) != 0) {
+                    handle = nullptr;
+                }
+            }
+            freeDevices(devices);
+        } else {
+            shared_->resolve(vid, pid, errcnt, errstr);
+            libusb_device *device = nullptr;
+            Shared::Location loc;
+            {
+                std::lock_guard<std::mutex> lock(shared_->mutex);
+                std::map<Shared::Serial, Shared::Location>::const_iterator it = shared_->locations.find(Shared::Serial(Shared::vidPid(vid, pid), serial));
+                if (it != shared_->locations.end()) {
+                    loc = it->second;
+                    for (size_t i = 0; i < shared_->devices.size() && device == nullptr; ++i) {
+                        if (Shared::location(shared_->devices[i]) == loc) {  // If the device is at the indexed location
+                            device = libusb_ref_device(shared_->devices[i]);
+                        }
+                    }
+                }
+            }
+            if (device != nullptr) {  // The device is opened after unlocking the mutex
+                libusb_device_descriptor desc;
+                std::string serialRead;
+                if (libusb_open(device, &handle) != 0) {
+                    handle = nullptr;
+                } else if (libusb_get_device_descriptor(device, &desc) != 0 || !Shared::readSerial(handle, desc.iSerialNumber, serialRead) || serialRead != serial) {  // If the serial number cannot be read back or does not match, the index entry is stale
+                    libusb_close(handle);
+                    handle = nullptr;
+                    std::lock_guard<std::mutex> lock(shared_->mutex);
+                    shared_->unindex(loc);  // The device is indexed again by resolve(), on the next attempt
+                }
+                libusb_unref_device(device);
+            }
+        }
+    }
+    return handle;
+}
+
+// Opens the device connected at the given location (bus number and port path), and returns its handle (or a null pointer if no device is connected there)
+// The device list is always refreshed first, since this function is meant to find devices that have just re-enumerated
+libusb_device_handle *USBContext::openDeviceAt(uint8_t bus, const std::vector<uint8_t> &ports) const
+{
+    libusb_device_handle *handle = nullptr;
+    if (!isNull()) {
+        int errcnt = 0;  // Errors are not reported here, since a null handle is returned anyway
+        std::string errstr;
+        Shared::Location loc(1, bus);
+        loc.insert(loc.end(), ports.begin(), ports.end());
+        libusb_device *device = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(shared_->mutex);
+            shared_->enumerate(errcnt, errstr);
+            for (size_t i = 0; i < shared_->devices.size() && device == nullptr; ++i) {
+                if (Shared::location(shared_->devices[i]) == loc) {  // If the device is at the given location
+                    device = libusb_ref_device(shared_->devices[i]);
+                }
+            }
+        }
+        if (device != nullptr) {  // The device is opened after unlocking the mutex, as in resolve()
+            if (libusb_open(device, &handle) != 0) {
+                handle = nullptr;
+            }
+            libusb_unref_device(device);
+        }
+    }
+    return handle;
+}
+
+// Discards the cached device list and retrieves it again
+void USBContext::refresh(int &errcnt, std::string &errstr) const
+{
+    if (isNull()) {
+        ++errcnt;
+        errstr += "In refresh(): context is null.\n";  // Program logic error
+    } else {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->enumerate(errcnt, errstr);
+    }
+}
+
+// Unreferences the devices returned by getDevices(), and clears the given vector
+void USBContext::freeDevices(std::vector<libusb_device *> &devices)
+{
+    for (size_t i = 0; i < devices.size(); ++i) {
+        libusb_unref_device(devices[i]);
+    }
+    devices.clear();
+}
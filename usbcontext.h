@@ -0,0 +1,63 @@
+/* USB context class - Version 1.0.0
+   Copyright (c) 2026 Samuel Lourenço
+
+   This library is free software: you can redistribute it and/or modify it
+   under the terms of the GNU Lesser General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or (at your
+   option) any later version.
+
+   This library is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+   FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+   License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this library.  If not, see <https://www.gnu.org/licenses/>.
+
+
+   Please feel free to contact me via e-mail: samuel.fmlourenco@gmail.com */
+
+
+#ifndef USBCONTEXT_H
+#define USBCONTEXT_H
+
+// Includes
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <libusb-1.0/libusb.h>
+
+// A reference-counted libusb context, meant to be shared by several CP2130 or ITUSB1Device objects
+// Copies of a USBContext object refer to the same libusb context, which is deinitialized when the last copy is destroyed
+// Since every copy refers to the same shared state, all functions are const, and the cached device list and serial index are guarded internally
+// Note that the events of the objects sharing a context must be handled by a single thread, since their transfer callbacks access per-object state without locking
+class USBContext
+{
+private:
+    struct Shared;
+
+    std::shared_ptr<Shared> shared_;
+
+public:
+    // Class definitions
+    static const int MAX_PORT_DEPTH = 7;  // Maximum depth of a port path, as per the USB 3.0 specification
+
+    USBContext();
+    explicit USBContext(std::nullptr_t);
+
+    libusb_context *get() const;
+    std::vector<libusb_device *> getDevices(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr) const;
+    std::list<std::string> getSerials(uint16_t vid, uint16_t pid, int &errcnt, std::string &errstr) const;
+    void handleEvents(int &errcnt, std::string &errstr) const;
+    bool isNull() const;
+    libusb_device_handle *openDevice(uint16_t vid, uint16_t pid, const std::string &serial) const;
+    libusb_device_handle *openDeviceAt(uint8_t bus, const std::vector<uint8_t> &ports) const;
+    void refresh(int &errcnt, std::string &errstr) const;
+
+    static void freeDevices(std::vector<libusb_device *> &devices);
+};
+
+#endif  // USBCONTEXT_H